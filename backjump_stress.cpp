@@ -0,0 +1,99 @@
+/*
+ * backjump_stress.cpp
+ * Purpose: Regression check of the backjump to the greatest common ancestor after a leaf equivalent to first_leaf or
+ * best_leaf, see process_leaf in nautyyy.h. Randomly relabelled Cayley graphs of Z_a x Z_c, which have large
+ * automorphism groups and so many equivalent leaves, are searched with every node invariant and target cell selector,
+ * once with and once without the backjump. The certificates of a graph and of its relabelled copy have to be the same
+ * in all four searches and so do the group orders. Prints the leaves visited with and without the backjump.
+ *
+ * Usage: backjump_stress [num_graphs] [seed]
+ * Returns: 0 if all searches agree and the backjump visits no more leaves in total, 1 otherwise
+ */
+
+#include <iostream>
+#include <sstream>
+#include <set>
+
+#include "nautyyy.h"
+
+
+/*
+ * cayley_graph(a, c, random)
+ *
+ * Returns: The Cayley graph of Z_a x Z_c for up to three random generators, vertex x*c+y is the element (x, y)
+ */
+Graph cayley_graph(unsigned int a, unsigned int c, std::mt19937& random){
+    unsigned int n = a * c;
+    SparseBuilder builder(n);
+    std::set<std::pair<unsigned int, unsigned int>> edges;
+    unsigned int num_generators = 1 + random() % 3;
+    for(unsigned int k=0; k<num_generators; k++){
+        unsigned int dx = random() % a, dy = random() % c;
+        for(unsigned int x=0; x<a; x++){
+            for(unsigned int y=0; y<c; y++){
+                unsigned int u = x*c + y, v = ((x+dx) % a)*c + (y+dy) % c;
+                if(u != v and edges.insert(std::minmax(u, v)).second){
+                    builder.add_edge(u, v);
+                }
+            }
+        }
+    }
+    return builder.freeze();
+}
+
+
+int main(int argc, char* argv[]) {
+
+    unsigned int num_graphs = 150, seed = 11;
+    if(argc > 1){
+        std::istringstream(argv[1])>>num_graphs;
+    }
+    if(argc > 2){
+        std::istringstream(argv[2])>>seed;
+    }
+    std::mt19937 random(seed);
+    const Options::InvarMethod invarmethods[] = {Options::none, Options::shape, Options::quotient, Options::trace};
+    const Partition::TargetcellMethod targetcellmethods[] = {Partition::first, Partition::first_smallest,
+                                                             Partition::joins};
+
+    unsigned long long leaves_with = 0, leaves_without = 0;
+    unsigned int mismatches = 0;
+    for(unsigned int i=0; i<num_graphs; i++){
+        Graph graph = cayley_graph(2 + random() % 6, 1 + random() % 5, random);
+        Permutation relabelling(graph.nof_vertices());
+        std::iota(relabelling.begin(), relabelling.end(), 0);
+        std::shuffle(relabelling.begin(), relabelling.end(), random);
+        Graph relabelled = perm_graph(graph, relabelling);
+
+        for(Options::InvarMethod invarmethod: invarmethods){
+            for(Partition::TargetcellMethod targetcellmethod: targetcellmethods){
+                Options options;
+                options.invarmethod = invarmethod;
+                options.targetcellmethod = targetcellmethod;
+                Options plain_options = options;
+                plain_options.use_backjump = false;
+
+                Nautyyy with(graph, options), with_relabelled(relabelled, options);
+                Nautyyy without(graph, plain_options), without_relabelled(relabelled, plain_options);
+                leaves_with += with.stats.leaves_visited + with_relabelled.stats.leaves_visited;
+                leaves_without += without.stats.leaves_visited + without_relabelled.stats.leaves_visited;
+
+                const Certificate& certificate = without.best_leaf.hash_of_perm_graph;
+                bool same = with.best_leaf.hash_of_perm_graph == certificate
+                            and with_relabelled.best_leaf.hash_of_perm_graph == certificate
+                            and without_relabelled.best_leaf.hash_of_perm_graph == certificate
+                            and with.stats.group_order == without.stats.group_order
+                            and with_relabelled.stats.group_order == without.stats.group_order
+                            and without_relabelled.stats.group_order == without.stats.group_order;
+                if(not same){
+                    mismatches++;
+                    std::cout<<"Mismatch on graph "<<i<<" with invarmethod "<<invarmethod<<" and targetcellmethod "
+                             <<targetcellmethod<<"."<<std::endl;
+                }
+            }
+        }
+    }
+    std::cout<<"Leaves visited with backjump: "<<leaves_with<<", without: "<<leaves_without<<". Mismatches: "
+             <<mismatches<<"."<<std::endl;
+    return (mismatches == 0 and leaves_with <= leaves_without) ? 0 : 1;
+}
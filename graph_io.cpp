@@ -0,0 +1,430 @@
+#include "graph_io.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NAUTYYY_HAVE_MMAP 1
+#endif
+
+
+MappedFile::MappedFile(const char* filename, bool sequential): begin_ptr(nullptr), length(0), fallback_buffer() {
+#ifdef NAUTYYY_HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){                                                                                       //wrong file input
+        throw std::runtime_error("Cannot open file.");
+    }
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0){
+        close(fd);
+        throw std::runtime_error("Cannot open file.");
+    }
+    length = file_stat.st_size;
+    if(length > 0){
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("Cannot map file into memory.");
+        }
+        madvise(mapped, length, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+        begin_ptr = static_cast<const char*>(mapped);
+    }
+    close(fd);                                                                    //the mapping stays valid without fd
+#else
+    (void) sequential;
+    std::ifstream file(filename, std::ios::binary);
+    if (not file) {                                                                                   //wrong file input
+        throw std::runtime_error("Cannot open file.");
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    fallback_buffer = content.str();
+    begin_ptr = fallback_buffer.data();
+    length = fallback_buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef NAUTYYY_HAVE_MMAP
+    if(begin_ptr){
+        munmap(const_cast<char*>(begin_ptr), length);
+    }
+#endif
+}
+
+
+namespace {
+
+const char binary_magic[8] = {'N', 'A', 'U', 'T', 'Y', 'Y', 'Y', 'G'};
+
+/*
+ * view_binary_graph(file)
+ *
+ * Checks the header of a mapped binary graph file, its size and the first and last offset, which takes constant time.
+ * Then builds a Sparse graph on top of the arrays, the graph keeps the mapping alive
+ */
+Sparse view_binary_graph(const std::shared_ptr<MappedFile>& file){
+    if(file->size() < sizeof(BinaryGraphHeader)){
+        throw std::runtime_error("Binary graph file is too short.");
+    }
+    const BinaryGraphHeader* header = reinterpret_cast<const BinaryGraphHeader*>(file->data());
+    if(header->byte_order != BinaryGraphHeader::byte_order_mark){
+        throw std::runtime_error("Binary graph file was written on a machine with a different byte order.");
+    }
+    if(header->version != BinaryGraphHeader::current_version){
+        throw std::runtime_error("Unsupported version of the binary graph format.");
+    }
+    std::uint64_t n = header->num_vertices;
+    bool colored = header->flags & BinaryGraphHeader::has_colors;
+    std::uint64_t num_words = (file->size() - sizeof(BinaryGraphHeader)) / 4;
+    if(header->adjacency_size > num_words){                          //checked first, 4 * adjacency_size could wrap
+        throw std::runtime_error("Binary graph file does not have the size given in its header.");
+    }
+    std::uint64_t expected_size = sizeof(BinaryGraphHeader)
+            + 4 * ((colored ? n : 0) + (n + 1) + header->adjacency_size);
+    if(file->size() != expected_size){
+        throw std::runtime_error("Binary graph file does not have the size given in its header.");
+    }
+    const char* arrays = file->data() + sizeof(BinaryGraphHeader);
+    const unsigned int* colors = colored ? reinterpret_cast<const unsigned int*>(arrays) : nullptr;
+    const unsigned int* offsets = reinterpret_cast<const unsigned int*>(arrays) + (colored ? n : 0);
+    const Vtype* adjacency = reinterpret_cast<const Vtype*>(offsets + n + 1);
+    if(offsets[0] != 0 or offsets[n] != header->adjacency_size){
+        throw std::runtime_error("Binary graph file has inconsistent offsets.");
+    }
+    return Sparse(file, header->num_vertices, offsets, adjacency, colors);
+}
+
+using EdgeList = std::vector<std::pair<Vtype, Vtype>>;
+
+/*
+ * Below a thread is only started for at least this many bytes of edge lines, smaller files are parsed sequentially
+ */
+const std::size_t min_bytes_per_thread = std::size_t(1) << 22;
+
+/*
+ * ChunkResult
+ * Purpose: What a single thread collects from its chunk of lines, merged in file order afterwards
+ * edges: the edges as pairs of 0-indexed vertices
+ * colors: pairs of (color, vertex) of dimacs 'n' lines
+ */
+struct ChunkResult{
+    EdgeList edges;
+    std::vector<std::pair<unsigned int, unsigned int>> colors;
+};
+
+inline bool is_blank(char c){
+    return c == ' ' or c == '\t' or c == '\r';
+}
+
+inline const char* skip_blanks(const char* pos, const char* end){
+    while(pos < end and is_blank(*pos)){
+        pos++;
+    }
+    return pos;
+}
+
+inline const char* line_end(const char* pos, const char* end){
+    const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+    return newline ? newline : end;
+}
+
+/*
+ * scan_uint(pos, end, value)
+ *
+ * Skips leading blanks and reads a non-negative decimal integer starting at pos, which is advanced past it.
+ * Returns: whether a number was found
+ */
+inline bool scan_uint(const char*& pos, const char* end, unsigned int& value){
+    pos = skip_blanks(pos, end);
+    if(pos == end or *pos < '0' or *pos > '9'){
+        return false;
+    }
+    unsigned long long result = 0;
+    while(pos < end and *pos >= '0' and *pos <= '9'){
+        result = result * 10 + (*pos - '0');
+        pos++;
+    }
+    value = static_cast<unsigned int>(result);
+    return true;
+}
+
+/*
+ * dimacs_lines(begin, end, num_vertices, result)
+ *
+ * Parses the 'e', 'n' and 'c' lines in [begin, end), vertices are shifted to start at 0
+ */
+void dimacs_lines(const char* begin, const char* end, unsigned int num_vertices, ChunkResult& result){
+    const unsigned int offset = 1;                                   //in dimacs format, vertices start at 1 and go to n
+    for(const char* pos = begin; pos < end; pos = line_end(pos, end) + 1){
+        const char* line = skip_blanks(pos, end);
+        if(line == end or *line == '\n' or *line == 'c'){
+            continue;                                                               //ignore empty and comment lines
+        }
+        char kind = *line++;
+        unsigned int first, second;
+        if(not (scan_uint(line, end, first) and scan_uint(line, end, second))){
+            throw std::runtime_error("File is not in correct dimacs format.");
+        }
+        if(first < offset or first > num_vertices){
+            throw std::runtime_error("Invalid file format, vertex out of range.");
+        }
+        if(kind == 'e'){
+            if(second < offset or second > num_vertices){
+                throw std::runtime_error("Invalid file format, vertex out of range.");
+            }
+            result.edges.emplace_back(first - offset, second - offset);
+        }
+        else if(kind == 'n'){
+            result.colors.emplace_back(second, first - offset);                      //sorted by color later on
+        }
+        else{
+            throw std::runtime_error("File is not in correct dimacs format.");        //a different case was expected
+        }
+    }
+}
+
+/*
+ * edge_list_lines(begin, end, num_vertices, result)
+ *
+ * Parses the lines "tail head" of format 1 in [begin, end)
+ */
+void edge_list_lines(const char* begin, const char* end, unsigned int num_vertices, ChunkResult& result){
+    for(const char* pos = begin; pos < end; pos = line_end(pos, end) + 1){
+        const char* line = skip_blanks(pos, end);
+        if(line == end or *line == '\n'){
+            continue;
+        }
+        unsigned int tail, head;
+        if(not (scan_uint(line, end, tail) and scan_uint(line, end, head))){      //each line must give a tail and head
+            throw std::runtime_error("Invalid file format, not the correct edge format.");
+        }
+        if(tail == head) {                                                          //graph is supposed to be undirected
+            throw std::runtime_error("Invalid file format: loops and parallel edges not allowed.");
+        }
+        if(tail >= num_vertices or head >= num_vertices){
+            throw std::runtime_error("Invalid file format, vertex out of range.");
+        }
+        result.edges.emplace_back(tail, head);
+    }
+}
+
+/*
+ * parse_in_chunks(begin, end, num_vertices, num_threads, size_hint, parser)
+ *
+ * Splits [begin, end) at line boundaries into chunks of roughly equal size, lets parser handle each of them on an
+ * own thread and returns the results in file order. Exceptions of a thread are rethrown in the calling thread.
+ */
+template<typename LineParser>
+std::vector<ChunkResult> parse_in_chunks(const char* begin, const char* end, unsigned int num_vertices,
+                                         unsigned int num_threads, std::size_t size_hint, LineParser parser){
+    std::size_t bytes = end - begin;
+    if(num_threads == 0){
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::size_t max_useful_threads = std::max<std::size_t>(1, bytes / min_bytes_per_thread);
+    num_threads = static_cast<unsigned int>(std::min<std::size_t>(num_threads, max_useful_threads));
+
+    std::vector<const char*> bounds{begin};
+    for(unsigned int t = 1; t < num_threads; t++){
+        const char* split = std::max(bounds.back(), begin + bytes * t / num_threads);
+        split = std::min(line_end(split, end) + 1, end);                       //move the split behind the next newline
+        bounds.push_back(split);
+    }
+    bounds.push_back(end);
+
+    std::vector<ChunkResult> results(num_threads);
+    for(unsigned int t = 0; t < num_threads; t++){
+        results[t].edges.reserve(size_hint / num_threads + 1);
+    }
+    if(num_threads == 1){
+        parser(begin, end, num_vertices, results[0]);
+        return results;
+    }
+
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> workers;
+    for(unsigned int t = 0; t < num_threads; t++){
+        workers.emplace_back([&, t](){
+            try{
+                parser(bounds[t], bounds[t+1], num_vertices, results[t]);
+            }
+            catch(...){
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    for(std::thread& worker: workers){
+        worker.join();
+    }
+    for(const std::exception_ptr& error: errors){
+        if(error){
+            std::rethrow_exception(error);
+        }
+    }
+    return results;
+}
+
+/*
+ * build(num_vertices, chunks, num_edges)
+ *
+ * Collects the parsed chunks in a SparseBuilder, turns the color pairs into the initial partition and freezes it
+ */
+Sparse build(unsigned int num_vertices, const std::vector<ChunkResult>& chunks, std::size_t num_edges){
+    SparseBuilder builder(num_vertices);
+    std::vector<std::pair<unsigned int, unsigned int>> colors;
+    std::size_t total_edges = 0;
+    for(const ChunkResult& chunk: chunks){
+        total_edges += chunk.edges.size();
+    }
+    builder.reserve(std::max(total_edges, num_edges));
+    for(const ChunkResult& chunk: chunks){
+        builder.add_edges(chunk.edges);
+        colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+    }
+                                                  //cells ordered by color, vertices of a cell in order of appearance
+    std::stable_sort(colors.begin(), colors.end(),
+            [](const std::pair<unsigned int, unsigned int>& a, const std::pair<unsigned int, unsigned int>& b){
+                return a.first < b.first;});
+    for(std::size_t i = 0; i < colors.size(); i++){
+        if(i == 0 or colors[i].first != colors[i-1].first){
+            builder.initial_partition.emplace_back();
+        }
+        builder.initial_partition.back().push_back(colors[i].second);
+    }
+    return builder.freeze();
+}
+
+}
+
+
+bool is_binary_graph(const char* data, std::size_t size){
+    return size >= sizeof(binary_magic) and std::memcmp(data, binary_magic, sizeof(binary_magic)) == 0;
+}
+
+void write_binary_graph(const Sparse& graph, const char* filename){
+    BinaryGraphHeader header{};
+    std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+    header.version = BinaryGraphHeader::current_version;
+    header.byte_order = BinaryGraphHeader::byte_order_mark;
+    header.flags = graph.is_colored() ? BinaryGraphHeader::has_colors : 0;
+    header.num_vertices = graph.nof_vertices();
+    header.adjacency_size = graph.offsets_data()[graph.nof_vertices()];
+
+    std::vector<unsigned int> colors;
+    for(unsigned int v=0; graph.is_colored() and v<graph.nof_vertices(); v++){
+        colors.push_back(graph.color(v));
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if(not file){
+        throw std::runtime_error("Cannot open file for writing.");
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(colors.data()), colors.size() * sizeof(unsigned int));
+    file.write(reinterpret_cast<const char*>(graph.offsets_data()), (header.num_vertices + 1) * sizeof(unsigned int));
+    file.write(reinterpret_cast<const char*>(graph.adjacency_data()), header.adjacency_size * sizeof(Vtype));
+    if(not file){
+        throw std::runtime_error("Writing the binary graph file failed.");
+    }
+}
+
+Sparse map_binary_graph(const char* filename, bool check_arrays){
+    Sparse graph = view_binary_graph(std::make_shared<MappedFile>(filename, false));
+    if(check_arrays){
+        check_graph_arrays(graph);
+    }
+    return graph;
+}
+
+void check_graph_arrays(const Sparse& graph){
+    const unsigned int* offsets = graph.offsets_data();
+    const Vtype* adjacency = graph.adjacency_data();
+    unsigned int n = graph.nof_vertices();
+    for(unsigned int v=0; v<n; v++){                    //every later traversal relies on these without any checks
+        if(offsets[v] > offsets[v+1]){
+            throw std::runtime_error("Graph has inconsistent offsets.");
+        }
+    }
+    for(unsigned int i=0; i<offsets[n]; i++){
+        if(adjacency[i] < 0 or static_cast<unsigned int>(adjacency[i]) >= n){
+            throw std::runtime_error("Graph has a neighbor that is not a vertex.");
+        }
+    }
+}
+
+Sparse read_graph(const char* filename, unsigned int num_threads){
+    std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>(filename);
+    if(is_binary_graph(mapped->data(), mapped->size())){
+        return view_binary_graph(mapped);                                      //used in place, nothing to parse
+    }
+    const MappedFile& file = *mapped;
+    const char* pos = file.data();
+    const char* end = pos + file.size();
+
+    if(pos != end and isalpha(*pos)){                                                      //file is of dimacs format
+        while(pos < end and (*pos == 'c' or *pos == '\n' or *pos == '\r')){
+            pos = line_end(pos, end) + 1;                                                           //ignore comments
+        }
+        if(pos >= end or *pos != 'p'){
+            throw std::runtime_error("File is not in correct dimacs format.");            //a different case was expected
+        }
+        pos++;
+        pos = skip_blanks(pos, end);
+        while(pos < end and isalpha(*pos)){
+            pos++;                                                                           //the format word, 'edge'
+        }
+        unsigned int num_vertices, num_edges;                                          //number of nodes and edges
+        if(not (scan_uint(pos, end, num_vertices) and scan_uint(pos, end, num_edges))){
+            throw std::runtime_error("File is not in correct dimacs format.");
+        }
+        pos = std::min(line_end(pos, end) + 1, end);
+        std::vector<ChunkResult> chunks = parse_in_chunks(pos, end, num_vertices, num_threads, num_edges, dimacs_lines);
+        return build(num_vertices, chunks, num_edges);
+    }
+
+    unsigned int num_nodes = 0;
+    if(not scan_uint(pos, end, num_nodes)){  //first line must contain a single number, the number of nodes of the graph
+        throw std::runtime_error("No number of vertices given, invalid file format.");
+    }
+    pos = std::min(line_end(pos, end) + 1, end);
+    const char* second_line_end = line_end(pos, end);
+    if(pos == second_line_end or (pos + 1 == second_line_end and *pos == '\r')){
+        return SparseBuilder(num_nodes).freeze();                                                     //no edges given
+    }
+
+    const char* space_pos = std::find_if(pos, second_line_end, is_blank);
+    //when there is a space in the right place, it is of format 1. Exception that space is encountered at end is handled
+    if(space_pos != second_line_end and std::find_if(space_pos, second_line_end,
+                                                     [](char c){return not is_blank(c);}) != second_line_end){
+        std::vector<ChunkResult> chunks = parse_in_chunks(pos, end, num_nodes, num_threads, 0, edge_list_lines);
+        return build(num_nodes, chunks, 0);                                                          //File is of Format 1
+    }
+
+    SparseBuilder builder(num_nodes);                                                                //File is of Format 2
+    for(unsigned int tail=0; tail<num_nodes; tail++) {
+        const char* row = skip_blanks(pos, end);
+        const char* row_end = row;
+        while(row_end < end and *row_end >= '0' and *row_end <= '1'){
+            row_end++;
+        }
+        if(row_end - row < static_cast<std::ptrdiff_t>(num_nodes)){
+            throw std::runtime_error("Invalid file format, not enough rows given.");
+        }
+        if(row[tail]=='1'){
+            throw std::runtime_error("Invalid file format: loops not allowed.");
+        }
+        for(unsigned int head=0; head<num_nodes; head++){
+            if(row[head]=='1'){
+                builder.add_edge(tail, head);                          //symmetric entries are merged when freezing
+            }
+        }
+        pos = std::min(line_end(row_end, end) + 1, end);
+    }
+    return builder.freeze();
+}
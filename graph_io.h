@@ -0,0 +1,131 @@
+#ifndef NAUTY_GRAPH_IO_H
+#define NAUTY_GRAPH_IO_H
+
+/*
+ * graph_io.h
+ * Purpose: Fast reading of graph files. A file is memory mapped and parsed in a single pass with a hand-written
+ * integer scanner, the edges are collected in flat arrays and directly frozen into the compressed adjacency arrays
+ * of a Sparse graph. Large files are split into chunks at line boundaries which are parsed in parallel.
+ * Additionally there is a binary format which is mapped into memory and used in place, without parsing or copying.
+ */
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "sparse_graph.h"
+
+
+/*
+ * MappedFile
+ * Purpose: Read-only view of the whole content of a file, kept alive as long as the object exists
+ *
+ * MappedFile(filename, sequential): Maps the file into memory, throws if it cannot be opened. sequential tells the
+ *                                  system that the file will be read front to back
+ * data(): pointer to the first byte of the file
+ * size(): number of bytes of the file
+ *
+ * On POSIX systems the file is mmap'ed, elsewhere it is simply read into a buffer.
+ */
+class MappedFile{
+    const char* begin_ptr;
+    std::size_t length;
+    std::string fallback_buffer;
+public:
+    explicit MappedFile(const char* filename, bool sequential = true);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const char* data() const { return begin_ptr; }
+    std::size_t size() const { return length; }
+};
+
+
+/*
+ * read_graph(filename, num_threads)
+ *
+ * Parameter: filename Name or path to a file of either of the following formats
+ *      Format 1:               //adjacency list
+ *      num_nodes               //number of nodes of the graph
+ *      node1_1 node1_2         //meaning there is and edge between node1_1 and node1_2
+ *      node2_1 node2_2
+ *      ...
+ *
+ *      Format 2:               //adjacency matrix
+ *      num_nodes               //number of nodes of the graph
+ *      10010...011             //the first row of the matrix, filled with 0 or 1
+ *
+ *      Format 3:               //dimacs, see http://www.tcs.hut.fi/Software/bliss/fileformat.shtml
+ *      p edge n m              //comment lines starting with c may precede this
+ *      n vertex color          //optional, the colors give the initial partition ordered by color
+ *      e tail head             //vertices start at 1
+ *
+ *            num_threads The maximal number of threads used to parse the edges, 0 lets the loader decide based on
+ *              the file size and hardware. Small files are always parsed sequentially.
+ *
+ * Returns: The frozen graph. Loops are rejected for formats 1 and 2 and parallel edges are merged.
+ */
+Sparse read_graph(const char* filename, unsigned int num_threads = 0);
+
+
+/*
+ * BinaryGraphHeader
+ * Purpose: The start of a binary graph file. All numbers are stored in native byte order and the header is followed by
+ * colors: num_vertices 32 bit colors, only if flags contains has_colors
+ * offsets: num_vertices+1 32 bit offsets of the CSR format
+ * adjacency: adjacency_size 32 bit neighbors
+ * These are exactly the arrays of a Sparse graph, so a mapped file can be used as its storage. The header is 32 bytes
+ * and every array a multiple of 4 bytes, so all arrays are properly aligned within the page aligned mapping.
+ */
+struct BinaryGraphHeader{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t flags;
+    std::uint32_t num_vertices;
+    std::uint64_t adjacency_size;
+
+    static const std::uint32_t current_version = 1;
+    static const std::uint32_t byte_order_mark = 0x01020304;
+    static const std::uint32_t has_colors = 1;
+};
+
+/*
+ * is_binary_graph(data, size)
+ *
+ * Returns: Whether the given file content starts with the magic bytes of a binary graph file
+ */
+bool is_binary_graph(const char* data, std::size_t size);
+
+/*
+ * write_binary_graph(graph, filename)
+ *
+ * Writes graph, including its colors, to filename in the binary format described above. Throws if that fails.
+ */
+void write_binary_graph(const Sparse& graph, const char* filename);
+
+/*
+ * map_binary_graph(filename, check_arrays)
+ *
+ * Maps a binary graph file into memory and returns a Sparse graph working directly on the mapped arrays. Only the
+ * header, the total size and the first and last offset are validated, so loading takes constant time independent of
+ * the size of the graph. With check_arrays, check_graph_arrays is run on the graph as well.
+ * read_graph(filename) recognizes binary files as well and hands them to this function, without check_arrays.
+ */
+Sparse map_binary_graph(const char* filename, bool check_arrays = false);
+
+/*
+ * check_graph_arrays(graph)
+ *
+ * Checks in one O(n+m) pass over the arrays of graph that the offsets do not decrease and that every neighbor is a
+ * vertex, which every traversal relies on. Meant for binary graph files of unknown origin, whose arrays are used as
+ * they are. Throws std::runtime_error otherwise.
+ */
+void check_graph_arrays(const Sparse& graph);
+
+#endif //NAUTY_GRAPH_IO_H
@@ -0,0 +1,352 @@
+#include "graph_reduction.h"
+
+
+GraphReduction::GraphReduction(const Graph& graph, bool use_colors)
+        : num_vertices(graph.nof_vertices()), blocks(graph.nof_vertices()), type(graph.nof_vertices(), 0),
+          num_types(1), degree(graph.nof_vertices()), alive(graph.nof_vertices(), true),
+          block_of(graph.nof_vertices()), reduced_vertices(), reduced(0u), color(),
+          neighborhood_hash(graph.nof_vertices(), 0){
+
+    for(bool true_twins: {false, true}){                            //at first all vertices are to be searched
+        is_changed[true_twins].assign(num_vertices, true);
+        changed[true_twins].resize(num_vertices);
+        std::iota(changed[true_twins].begin(), changed[true_twins].end(), 0);
+    }
+    if(use_colors and graph.is_colored()){                 //the colors are the first types, no_color the greatest one
+        std::vector<std::pair<std::vector<unsigned int>, Vertex>> keys;
+        for(Vertex v=0; v<num_vertices; v++){
+            color.push_back(graph.color(v));
+            keys.emplace_back(std::vector<unsigned int>{color[v]}, v);
+        }
+        num_types = 0;
+        assign_new_types(keys);
+    }
+    for(Vertex v=0; v<num_vertices; v++){
+        degree[v] = graph.degree(v);
+        block_of[v] = v;
+        for(Vtype neighbor: graph.neighbors(v)){
+            neighborhood_hash[v] += hash_point(neighbor);
+        }
+    }
+
+    peel_pendants(graph);                                   //collapsing twins may create new pendants and vice versa
+    while(collapse_twins(graph)){
+        peel_pendants(graph);
+    }
+
+    std::vector<unsigned int> reduced_index(num_vertices);             //the remaining vertices are numbered in order
+    for(Vertex v=0; v<num_vertices; v++){
+        if(alive[v]){
+            reduced_index[v] = reduced_vertices.size();
+            reduced_vertices.push_back(v);
+        }
+    }
+    SparseBuilder builder(reduced_vertices.size());
+    for(Vertex v: reduced_vertices){
+        for(Vtype neighbor: graph.neighbors(v)){
+            if(alive[neighbor] and static_cast<Vtype>(v) < neighbor){
+                builder.add_edge(reduced_index[v], reduced_index[neighbor]);
+            }
+        }
+    }
+    std::vector<unsigned int> by_type(reduced_vertices.size());       //a cell for each type, ordered by the types
+    std::iota(by_type.begin(), by_type.end(), 0);
+    std::stable_sort(by_type.begin(), by_type.end(), [this](unsigned int a, unsigned int b){
+        return type[reduced_vertices[a]] < type[reduced_vertices[b]];
+    });
+    for(std::size_t i=0; i<by_type.size(); i++){
+        if(i == 0 or type[reduced_vertices[by_type[i]]] != type[reduced_vertices[by_type[i-1]]]){
+            builder.initial_partition.emplace_back();
+        }
+        builder.initial_partition.back().push_back(by_type[i]);
+    }
+    reduced = builder.freeze();
+}
+
+
+std::vector<Vertex> GraphReduction::alive_neighbors(const Graph& graph, Vertex vertex) const{
+    std::vector<Vertex> neighbors;
+    for(Vtype neighbor: graph.neighbors(vertex)){
+        if(alive[neighbor]){
+            neighbors.push_back(neighbor);
+        }
+    }
+    return neighbors;
+}
+
+
+void GraphReduction::assign_new_types(std::vector<std::pair<std::vector<unsigned int>, Vertex>>& keys){
+    std::sort(keys.begin(), keys.end());
+    unsigned int new_types = 0;
+    for(std::size_t i=0; i<keys.size(); i++){
+        if(i > 0 and keys[i].first != keys[i-1].first){
+            new_types++;
+        }
+        type[keys[i].second] = num_types + new_types;
+        mark_changed(keys[i].second);
+    }
+    num_types += new_types + 1;
+}
+
+
+bool GraphReduction::peel_pendants(const Graph& graph){
+    auto only_neighbor = [&](Vertex vertex){                            //the neighbor of a vertex of degree one
+        for(Vtype neighbor: graph.neighbors(vertex)){
+            if(alive[neighbor]){
+                return static_cast<Vertex>(neighbor);
+            }
+        }
+        return vertex;
+    };
+    std::vector<Vertex> pendants;
+    for(Vertex v=0; v<num_vertices; v++){
+        if(alive[v] and degree[v] == 1 and degree[only_neighbor(v)] > 1){
+            pendants.push_back(v);
+        }
+    }
+    bool peeled = not pendants.empty();
+    while(not pendants.empty()){                        //a round folds all vertices that are pendant at its start
+        std::vector<std::pair<Vertex, Vertex>> folds;                                         //pairs (parent, pendant)
+        for(Vertex pendant: pendants){
+            folds.emplace_back(only_neighbor(pendant), pendant);
+        }
+        for(const std::pair<Vertex, Vertex>& fold: folds){
+            remove_vertex(graph, fold.second);
+        }
+        std::sort(folds.begin(), folds.end(), [this](const std::pair<Vertex, Vertex>& a,
+                                                    const std::pair<Vertex, Vertex>& b){
+            return a.first != b.first ? a.first < b.first : type[a.second] < type[b.second];
+        });
+                                      //the new type of a parent is its old one and the types of its pendants, sorted
+        std::vector<std::pair<std::vector<unsigned int>, Vertex>> keys;
+        for(std::size_t i=0; i<folds.size(); i++){
+            Vertex parent = folds[i].first;
+            if(i == 0 or parent != folds[i-1].first){
+                keys.emplace_back(std::vector<unsigned int>{type[parent]}, parent);
+            }
+            keys.back().first.push_back(type[folds[i].second]);
+            blocks[block_of[parent]].pendants.emplace_back(type[folds[i].second], block_of[folds[i].second]);
+        }
+        assign_new_types(keys);
+        pendants.clear();
+        for(const std::pair<std::vector<unsigned int>, Vertex>& key: keys){  //only parents can become pendants now
+            Vertex parent = key.second;
+            if(degree[parent] == 1 and degree[only_neighbor(parent)] > 1){
+                pendants.push_back(parent);
+            }
+        }
+    }
+    return peeled;
+}
+
+
+bool GraphReduction::collapse_twins(const Graph& graph){
+    bool collapsed = false;
+    for(bool true_twins: {false, true}){
+        std::vector<std::uint64_t> touched;                 //the buckets of the changed vertices, sorted by their hash
+        for(Vertex v: changed[true_twins]){
+            is_changed[true_twins][v] = false;
+            if(alive[v]){
+                std::uint64_t hash = twin_hash(v, true_twins);
+                twin_buckets[true_twins][hash].push_back(v);
+                touched.push_back(hash);
+            }
+        }
+        changed[true_twins].clear();
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+                 //vertices of the same type and neighborhood, the closed one for true twins, all found before collapsing
+        std::vector<std::vector<Vertex>> classes;
+        for(std::uint64_t hash: touched){
+            std::vector<Vertex>& bucket = twin_buckets[true_twins][hash];      //drops outdated and repeated entries
+            bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [&](Vertex v){
+                return not alive[v] or twin_hash(v, true_twins) != hash;
+            }), bucket.end());
+            std::sort(bucket.begin(), bucket.end());
+            bucket.erase(std::unique(bucket.begin(), bucket.end()), bucket.end());
+            if(bucket.size() < 2){
+                continue;
+            }
+            std::vector<std::pair<std::vector<unsigned int>, Vertex>> neighborhoods;    //equal hashes may still differ
+            for(Vertex v: bucket){
+                std::vector<unsigned int> key = alive_neighbors(graph, v);
+                if(true_twins){
+                    key.insert(std::lower_bound(key.begin(), key.end(), v), v);
+                }
+                key.insert(key.begin(), type[v]);
+                neighborhoods.emplace_back(std::move(key), v);
+            }
+            std::sort(neighborhoods.begin(), neighborhoods.end());    //each class is sorted by its vertices as well
+            for(std::size_t first=0, last=0; first<neighborhoods.size(); first=last){
+                while(last < neighborhoods.size() and neighborhoods[last].first == neighborhoods[first].first){
+                    last++;
+                }
+                if(last - first >= 2){
+                    classes.emplace_back();
+                    for(std::size_t i=first; i<last; i++){
+                        classes.back().push_back(neighborhoods[i].second);
+                    }
+                }
+            }
+        }
+        std::sort(classes.begin(), classes.end());
+
+        std::vector<std::pair<std::vector<unsigned int>, Vertex>> keys;
+        for(const std::vector<Vertex>& twins_class: classes){
+            Vertex representative = twins_class.front();               //the smallest vertex stands for the class
+            ReductionBlock twins;
+            for(Vertex twin: twins_class){
+                twins.members.push_back(block_of[twin]);
+                if(twin != representative){
+                    remove_vertex(graph, twin);
+                }
+            }
+            blocks.push_back(twins);
+            block_of[representative] = blocks.size() - 1;
+            keys.emplace_back(std::vector<unsigned int>{type[representative], true_twins,
+                                                        static_cast<unsigned int>(twins_class.size())}, representative);
+        }
+        if(not keys.empty()){
+            assign_new_types(keys);
+            collapsed = true;
+        }
+    }
+    return collapsed;
+}
+
+
+void GraphReduction::remove_vertex(const Graph& graph, Vertex vertex){
+    alive[vertex] = false;
+    for(Vtype neighbor: graph.neighbors(vertex)){
+        if(alive[neighbor]){
+            degree[neighbor]--;
+            neighborhood_hash[neighbor] -= hash_point(vertex);
+            mark_changed(neighbor);
+        }
+    }
+}
+
+
+void GraphReduction::mark_changed(Vertex vertex){
+    for(bool true_twins: {false, true}){
+        if(not is_changed[true_twins][vertex]){
+            is_changed[true_twins][vertex] = true;
+            changed[true_twins].push_back(vertex);
+        }
+    }
+}
+
+
+std::uint64_t GraphReduction::hash_point(std::uint64_t point){
+    point += 0x9e3779b97f4a7c15ull;                                        //the finalizer of splitmix64
+    point = (point ^ (point >> 30)) * 0xbf58476d1ce4e5b9ull;
+    point = (point ^ (point >> 27)) * 0x94d049bb133111ebull;
+    return point ^ (point >> 31);
+}
+
+
+std::uint64_t GraphReduction::twin_hash(Vertex vertex, bool true_twins) const{
+    std::uint64_t neighborhood = neighborhood_hash[vertex] + (true_twins ? hash_point(vertex) : 0);
+    return hash_point(neighborhood ^ hash_point(~static_cast<std::uint64_t>(type[vertex])));
+}
+
+
+void GraphReduction::expand_block(unsigned int block, std::vector<Vertex>& out) const{
+    std::vector<unsigned int> stack{block};        //depth first, the block itself, then its members and its pendants
+    while(not stack.empty()){
+        unsigned int current = stack.back();
+        stack.pop_back();
+        if(current < num_vertices){
+            out.push_back(current);
+        }
+        const ReductionBlock& content = blocks[current];
+        for(auto pendant = content.pendants.rbegin(); pendant != content.pendants.rend(); pendant++){
+            stack.push_back(pendant->second);
+        }
+        for(auto member = content.members.rbegin(); member != content.members.rend(); member++){
+            stack.push_back(*member);
+        }
+    }
+}
+
+
+bool GraphReduction::is_trivial() const{
+    return reduced_vertices.size() == num_vertices;
+}
+
+unsigned int GraphReduction::nof_removed_vertices() const{
+    return num_vertices - reduced_vertices.size();
+}
+
+const Graph& GraphReduction::reduced_graph() const{
+    return reduced;
+}
+
+
+Permutation GraphReduction::expand_labelling(const Permutation& reduced_labelling) const{
+    Permutation reduced_order(reduced_labelling.size());
+    for(unsigned int i=0; i<reduced_labelling.size(); i++){
+        reduced_order[reduced_labelling[i]] = i;
+    }
+    std::vector<Vertex> order;
+    order.reserve(num_vertices);
+    for(unsigned int reduced_vertex: reduced_order){
+        expand_block(block_of[reduced_vertices[reduced_vertex]], order);
+    }
+    if(not color.empty()){
+        std::stable_sort(order.begin(), order.end(), [this](Vertex a, Vertex b){ return color[a] < color[b]; });
+    }
+    Permutation labelling(num_vertices);
+    for(unsigned int i=0; i<num_vertices; i++){
+        labelling[order[i]] = i;
+    }
+    return labelling;
+}
+
+
+PermGroup GraphReduction::expand_automorphisms(const PermGroup& reduced_automorphisms) const{
+    PermGroup automorphisms;
+    Permutation identity(num_vertices);
+    std::iota(identity.begin(), identity.end(), 0);
+
+    std::vector<std::vector<Vertex>> expansions(reduced_vertices.size());
+    for(unsigned int i=0; i<reduced_vertices.size(); i++){
+        expand_block(block_of[reduced_vertices[i]], expansions[i]);
+    }
+    for(const Permutation& reduced_automorphism: reduced_automorphisms){   //blocks of the same type map in order
+        Permutation automorphism(identity);
+        for(unsigned int i=0; i<reduced_vertices.size(); i++){
+            for(std::size_t k=0; k<expansions[i].size(); k++){
+                automorphism[expansions[i][k]] = expansions[reduced_automorphism[i]][k];
+            }
+        }
+        automorphisms.push_back(automorphism);
+    }
+
+    auto swap_blocks = [&](unsigned int first, unsigned int second){
+        std::vector<Vertex> first_vertices, second_vertices;
+        expand_block(first, first_vertices);
+        expand_block(second, second_vertices);
+        Permutation automorphism(identity);
+        for(std::size_t k=0; k<first_vertices.size(); k++){
+            automorphism[first_vertices[k]] = second_vertices[k];
+            automorphism[second_vertices[k]] = first_vertices[k];
+        }
+        automorphisms.push_back(automorphism);
+    };
+    for(const ReductionBlock& block: blocks){                  //transpositions of neighbors generate the symmetric group
+        for(std::size_t i=1; i<block.members.size(); i++){
+            swap_blocks(block.members[i-1], block.members[i]);
+        }
+        std::map<unsigned int, unsigned int> last_of_type;      //pendants of one type may come from different rounds
+        for(const std::pair<unsigned int, unsigned int>& pendant: block.pendants){
+            auto last = last_of_type.find(pendant.first);
+            if(last != last_of_type.end()){
+                swap_blocks(last->second, pendant.second);
+            }
+            last_of_type[pendant.first] = pendant.second;
+        }
+    }
+    return automorphisms;
+}
@@ -0,0 +1,152 @@
+#ifndef NAUTY_GRAPH_REDUCTION_H
+#define NAUTY_GRAPH_REDUCTION_H
+
+/*
+ * graph_reduction.h
+ * Purpose: Preprocessing of a graph before its search tree is traversed. Vertices that are handled combinatorially
+ * are removed and encoded in the colors of the remaining ones:
+ * (i) pendant trees, i.e. vertices of degree one, are folded into their neighbor, round by round, and
+ * (ii) classes of twins, vertices with the same neighbors (false twins) or the same closed neighborhoods (true twins),
+ * are collapsed into a single vertex.
+ * Both are repeated until neither applies anymore. What remains is the reduced graph, colored by the type of what each
+ * vertex stands for. A canonical labelling and automorphisms of it are expanded to ones of the original graph.
+ *
+ * Every removed vertex belongs to a block: a block is either a single vertex of the graph or a class of twins whose
+ * members are blocks of the same type, plus the pendant blocks folded into it. If two vertices of the reduced graph
+ * are adjacent, all outer vertices of their blocks are adjacent in the graph, the pendant blocks hang off the outer
+ * vertices of the block they were folded into. Blocks of the same type are isomorphic and expanding them in the same
+ * order gives the isomorphism between them position by position.
+ *
+ * For reference see the preprocessing of Saucy and Traces, e.g. (2013) McKay.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <numeric>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+
+#include "sparse_graph.h"
+
+using Graph = Sparse;
+using Permutation = std::vector<unsigned int>;
+using PermGroup = std::vector<Permutation>;
+using Vertex = unsigned int;
+
+
+/*
+ * ReductionBlock
+ * Purpose: A block of vertices represented by a single vertex after the reduction, see above
+ * members: the blocks forming a class of twins or empty if the block is the single vertex with the same index
+ * pendants: the blocks folded into this one with their types, in the order they were folded
+ */
+struct ReductionBlock{
+    std::vector<unsigned int> members;
+    std::vector<std::pair<unsigned int, unsigned int>> pendants;
+};
+
+
+/*
+ * GraphReduction
+ * Purpose: Computes the reduction of a graph and translates between it and the original graph
+ *
+ * Member variables:
+ * num_vertices: the number of vertices of the original graph
+ * blocks: all blocks, the first num_vertices of them are the single vertices of the graph
+ * type: for each vertex still in the graph the type of its block. Types are numbered in an order only depending on
+ *       the graph and its colors, so the reduction of isomorphic graphs gives the same types
+ * num_types: the number of types used so far, new types are numbered from here on
+ * degree: for each vertex still in the graph its degree among the others
+ * alive: whether a vertex is still in the graph, the others have been folded or collapsed into another one
+ * block_of: for each vertex still in the graph the block it stands for
+ * reduced_vertices: the vertices of the reduced graph in the order of its vertex numbers
+ * reduced: the reduced graph, colored by the types of its vertices
+ * color: the colors of the graph if they are kept, otherwise empty
+ * neighborhood_hash: for each vertex still in the graph the sum of hash_point over its neighbors still in the graph
+ * changed, is_changed: for false twins at index 0 and true twins at index 1 the vertices whose type or neighborhood
+ *                      changed since the last time twins of that kind were searched, and a flag for each vertex
+ * twin_buckets: for false and true twins the vertices by twin_hash when it was last computed, possibly outdated
+ *
+ * GraphReduction(graph, use_colors): Reduces the graph. If use_colors is set, the colors of the graph have to be kept,
+ *                                    otherwise the graph is treated as uncolored
+ * is_trivial(): Whether nothing could be removed, so the reduced graph is the graph itself
+ * nof_removed_vertices(): The number of vertices that were removed
+ * reduced_graph(): The reduced graph
+ */
+class GraphReduction{
+    unsigned int num_vertices;
+    std::vector<ReductionBlock> blocks;
+    std::vector<unsigned int> type;
+    unsigned int num_types;
+    std::vector<unsigned int> degree;
+    std::vector<bool> alive;
+    std::vector<unsigned int> block_of;
+    std::vector<Vertex> reduced_vertices;
+    Graph reduced;
+    std::vector<unsigned int> color;
+    std::vector<std::uint64_t> neighborhood_hash;
+    std::vector<Vertex> changed[2];
+    std::vector<bool> is_changed[2];
+    std::unordered_map<std::uint64_t, std::vector<Vertex>> twin_buckets[2];
+
+    /*
+     * alive_neighbors(graph, vertex) Returns the sorted neighbors of vertex still in the graph
+     * peel_pendants(graph) Folds vertices of degree one into their neighbor in rounds, all vertices whose degree is one
+     *                      at the start of a round at once, until there are none. Two adjacent vertices of degree one
+     *                      are left alone. Returns whether any vertex was folded
+     * collapse_twins(graph) Collapses all classes of false twins and then all classes of true twins of the same type
+     *                       into their smallest vertex. Returns whether any class was collapsed. A class the last
+     *                       search missed contains a changed vertex, so only the buckets of the changed vertices are
+     *                       searched and the work per round is linear in the changes, not in the size of the graph
+     * remove_vertex(graph, vertex) Takes vertex out of the graph and updates the degrees and neighborhood hashes of
+     *                              its neighbors, which are marked as changed
+     * mark_changed(vertex) Marks vertex as changed for both kinds of twins
+     * hash_point(point) A fixed 64 bit mix of point
+     * twin_hash(vertex, true_twins) Hash of the type and the open or, for true twins, closed neighborhood of vertex,
+     *                               equal for twins
+     * assign_new_types(keys) Gives each vertex of keys, a list of pairs of a key and a vertex, a new type so that equal
+     *                        keys give the same type and the types are ordered as the keys
+     * expand_block(block, out) Appends the vertices of the graph in the block to out, in canonical order
+     */
+    std::vector<Vertex> alive_neighbors(const Graph& graph, Vertex vertex) const;
+    bool peel_pendants(const Graph& graph);
+    bool collapse_twins(const Graph& graph);
+    void remove_vertex(const Graph& graph, Vertex vertex);
+    void mark_changed(Vertex vertex);
+    static std::uint64_t hash_point(std::uint64_t point);
+    std::uint64_t twin_hash(Vertex vertex, bool true_twins) const;
+    void assign_new_types(std::vector<std::pair<std::vector<unsigned int>, Vertex>>& keys);
+    void expand_block(unsigned int block, std::vector<Vertex>& out) const;
+
+public:
+    GraphReduction(const Graph& graph, bool use_colors);
+    bool is_trivial() const;
+    unsigned int nof_removed_vertices() const;
+    const Graph& reduced_graph() const;
+
+    /*
+     * expand_labelling(reduced_labelling)
+     *
+     * Parameter: reduced_labelling A canonical labelling of the reduced graph, as the leaf_perm of a Leaf
+     *
+     * Returns: A canonical labelling of the graph. The blocks are placed in the order of the vertices of the reduced
+     *          graph in reduced_labelling, each of them expanded in canonical order. If the colors are kept, the
+     *          vertices are then ordered by color first, as in the leaves of a search on the graph itself
+     */
+    Permutation expand_labelling(const Permutation& reduced_labelling) const;
+
+    /*
+     * expand_automorphisms(reduced_automorphisms)
+     *
+     * Parameter: reduced_automorphisms Automorphisms of the reduced graph, respecting its colors
+     *
+     * Returns: Automorphisms of the graph generating the same group as the reduced automorphisms together with the
+     *          symmetries inside blocks: each reduced automorphism maps the blocks onto each other position by position,
+     *          and neighboring members of a class of twins or pendant blocks of the same type are swapped
+     */
+    PermGroup expand_automorphisms(const PermGroup& reduced_automorphisms) const;
+};
+
+#endif //NAUTY_GRAPH_REDUCTION_H
@@ -1,7 +1,9 @@
 #include <iostream>
+#include <sstream>
 #include <getopt.h>
 
 #include "nautyyy.h"
+#include "graph_io.h"
 
 void print_help(){
     std::cout<<"Usage: Nautyyy.exe [options] graph1.txt graph2.txt"<<std::endl;
@@ -10,12 +12,27 @@ void print_help(){
     std::cout<<"-s|--stats              :Enables output of statistics gathered during the algorithm."<<std::endl;
     std::cout<<"-t|--time               :Enables output of execution time."<<std::endl;
     std::cout<<"-i|--invarmethod  arg   :Change invariant used during algorithm."<<std::endl;
-    std::cout<<"                         n for none, s for shape, r for refinement, i for number of cells."<<std::endl;
+    std::cout<<"                         n for none, s for shape, r for refinement, i for number of cells,"<<std::endl;
+    std::cout<<"                         q for quotient graph hash, t for trace with early abort."<<std::endl;
     std::cout<<"-c|--tcmethod           :Change targetcell selector used during algorithm."<<std::endl;
     std::cout<<"                         f for first, s for first_smallest, j for joins"<<std::endl;
+    std::cout<<"-v|--vertexinvar  arg   :Split nodes further by a vertex invariant, for strongly regular graphs."<<std::endl;
+    std::cout<<"                         d for distances, a for adjtriang, t for triples, q for cellquads."<<std::endl;
+    std::cout<<"-l|--invarlevels  arg   :Levels of the nodes the vertex invariant is used on as min,max or max,"<<std::endl;
+    std::cout<<"                         the root is at level 1. Default 1,1."<<std::endl;
+    std::cout<<"-w|--wl           arg   :Use 2-dimensional Weisfeiler-Leman refinement on the nodes up to this level,"<<std::endl;
+    std::cout<<"                         1 for only the root. Costs O(n^3) per node, for CFI type graphs."<<std::endl;
+    std::cout<<"-e|--reduce             :Removes pendant trees and twins before the search, for sparse graphs."<<std::endl;
+    std::cout<<"-d|--components         :Searches the connected components separately and in parallel."<<std::endl;
+    std::cout<<"-o|--renumber           :Renumbers the vertices in reverse Cuthill-McKee order for memory locality."<<std::endl;
+    std::cout<<"-j|--threads      arg   :Searches the search tree with this many threads, 0 for one per core. Default 1."<<std::endl;
     std::cout<<"-u|--use_implicit       :Enables use of implicit automorphisms for pruning."<<std::endl;
     std::cout<<"-p|--partition          :Enables possibility of using an initial partition instead of unit partition."<<std::endl;
     std::cout<<"-r|--random             :Runs the algorithm on a random permutation of the given graph."<<std::endl;
+    std::cout<<"-b|--binary             :Converts all given graphs to the binary format, graph.txt to graph.txt.bin."<<std::endl;
+    std::cout<<"                         Binary graphs can be given as input instead of text files."<<std::endl;
+    std::cout<<"-k|--check              :Checks all offsets and neighbors of the input graphs before the search, in"<<std::endl;
+    std::cout<<"                         O(n+m). Binary graphs are otherwise used as they are."<<std::endl;
 }
 
 
@@ -25,6 +42,8 @@ void print_help(){
 int main(int argc, char* argv[]) {
 
     Options nauty_settings{};
+    bool convert_to_binary = false;
+    bool check_arrays = false;
 
     int opt;
     int option_index = 0;
@@ -34,12 +53,22 @@ int main(int argc, char* argv[]) {
             {"time", no_argument, nullptr, 't'},
             {"invarmethod", required_argument, nullptr, 'i'},
             {"tcmethod", required_argument, nullptr, 'c'},
+            {"vertexinvar", required_argument, nullptr, 'v'},
+            {"invarlevels", required_argument, nullptr, 'l'},
+            {"wl", required_argument, nullptr, 'w'},
+            {"reduce", no_argument, nullptr, 'e'},
+            {"components", no_argument, nullptr, 'd'},
+            {"renumber", no_argument, nullptr, 'o'},
+            {"threads", required_argument, nullptr, 'j'},
             {"use_implicit", no_argument, nullptr, 'u'},
             {"partition", no_argument, nullptr, 'p'},
             {"random", no_argument, nullptr, 'r'},
+            {"binary", no_argument, nullptr, 'b'},
+            {"check", no_argument, nullptr, 'k'},
+            {nullptr, 0, nullptr, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "hsti:c:nupr", long_options, &option_index)) != -1){
+    while ((opt = getopt_long(argc, argv, "hsti:c:v:l:w:edoj:uprbk", long_options, &option_index)) != -1){
         switch (opt) {
 
             default:
@@ -68,6 +97,12 @@ int main(int argc, char* argv[]) {
                 else if(*optarg=='c'){
                     nauty_settings.invarmethod = Options::num_cells;
                 }
+                else if(*optarg=='q'){
+                    nauty_settings.invarmethod = Options::quotient;
+                }
+                else if(*optarg=='t'){
+                    nauty_settings.invarmethod = Options::trace;
+                }
                 else{
                     std::cout<<"The invarmethod was not correctly specified."<<std::endl;
                     std::cout<<"Program failed."<<std::endl;
@@ -90,6 +125,72 @@ int main(int argc, char* argv[]) {
                     return -1;
                 }
                 break;
+            case 'v':
+                if(*optarg=='d'){
+                    nauty_settings.vertex_invariant = Partition::distances;
+                }
+                else if(*optarg=='a'){
+                    nauty_settings.vertex_invariant = Partition::adjtriang;
+                }
+                else if(*optarg=='t'){
+                    nauty_settings.vertex_invariant = Partition::triples;
+                }
+                else if(*optarg=='q'){
+                    nauty_settings.vertex_invariant = Partition::cellquads;
+                }
+                else{
+                    std::cout<<"The vertex invariant was not correctly specified."<<std::endl;
+                    std::cout<<"Program failed."<<std::endl;
+                    return -1;
+                }
+                break;
+            case 'l': {
+                unsigned int min_level = 1, max_level = 0;
+                std::istringstream levels(optarg);
+                levels>>max_level;
+                if(not levels.eof() and levels.peek() == ','){                  //two levels given as min,max
+                    min_level = max_level;
+                    levels.ignore();
+                    levels>>max_level;
+                }
+                if(levels.fail() or not levels.eof() or min_level < 1 or max_level < min_level){
+                    std::cout<<"The levels of the vertex invariant were not correctly specified."<<std::endl;
+                    std::cout<<"Program failed."<<std::endl;
+                    return -1;
+                }
+                nauty_settings.min_vertex_invar_level = min_level;
+                nauty_settings.max_vertex_invar_level = max_level;
+                break;
+            }
+            case 'w': {
+                std::istringstream level(optarg);
+                level>>nauty_settings.max_2wl_level;
+                if(level.fail() or not level.eof()){
+                    std::cout<<"The level of the 2-WL refinement was not correctly specified."<<std::endl;
+                    std::cout<<"Program failed."<<std::endl;
+                    return -1;
+                }
+                break;
+            }
+            case 'e':
+                nauty_settings.use_reduction = true;
+                break;
+            case 'd':
+                nauty_settings.use_components = true;
+                break;
+            case 'o':
+                nauty_settings.use_renumbering = true;
+                break;
+            case 'j': {
+                std::istringstream threads(optarg);
+                threads>>nauty_settings.num_threads;
+                if(threads.fail() or not threads.eof()){
+                    std::cout<<"The number of threads was not correctly specified."<<std::endl;
+                    std::cout<<"Program failed."<<std::endl;
+                    return -1;
+                }
+                break;
+            }
             case 'u':
                 nauty_settings.use_implicit_pruning = true;
                 break;
@@ -99,6 +200,12 @@ int main(int argc, char* argv[]) {
             case 'r':
                 nauty_settings.use_random_perm_of_graph = true;
                 break;
+            case 'b':
+                convert_to_binary = true;
+                break;
+            case 'k':
+                check_arrays = true;
+                break;
         }
     }
     if((not nauty_settings.use_unit_partition) and nauty_settings.use_random_perm_of_graph){
@@ -108,6 +215,22 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    if(convert_to_binary){
+        try{
+            for(int i = optind; i < argc; i++){                       //every remaining argument is a graph to convert
+                std::string binary_file = std::string(argv[i]) + ".bin";
+                write_binary_graph(Sparse(argv[i]), binary_file.c_str());
+                std::cout<<"Converted "<<argv[i]<<" to "<<binary_file<<"."<<std::endl;
+            }
+        }
+        catch (const std::runtime_error& e){
+            std::cout<<e.what()<<std::endl;
+            std::cout<<"Program failed."<<std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
     //optind is the index in argv after going through all the options, now the arguments are given
     char const* file1 = (argc>1) ? argv[optind] : "../Graphs/test12_1.txt";
     char const* file2 = (argc>2) ? argv[optind+1] : "../Graphs/test12_2.txt";
@@ -116,6 +239,10 @@ int main(int argc, char* argv[]) {
         //I'm using this format of the main function to showcase the different methods of calling the Nautyyy algorithm
         std::cout<<"Begin Nautyyy: "<<std::endl;
         Graph g = Sparse(file1);
+        if(check_arrays){
+            check_graph_arrays(g);
+            check_graph_arrays(Sparse(file2));
+        }
         Nautyyy g_nautyyy(g, nauty_settings);
 
         bool isomorphic = (g_nautyyy.best_leaf.hash_of_perm_graph == Nautyyy(file2, nauty_settings).best_leaf.hash_of_perm_graph);
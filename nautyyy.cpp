@@ -7,11 +7,65 @@ void Statistics::print() const {
              if(num_pruned_implicitly) {
                  std::cout<<" by implicit automorphisms: "<< num_pruned_implicitly;
              }
-             std::cout<<".\nRefined " << refinements_made << " times."
-             <<" Canonical updates: " << best_leaf_updates<<". Backtracks: "<<times_backtracked
+             if(leaf_table_lookups) {
+                 std::cout<<". Leaf table hits: "<<leaf_table_hits<<" of "<<leaf_table_lookups<<" lookups ("
+                          <<100.0 * leaf_table_hits / leaf_table_lookups<<"%)";
+             }
+             std::cout<<".\nRefined " << refinements_made << " times.";
+             if(automorphisms_overwritten) {
+                 std::cout<<" Automorphisms overwritten: "<<automorphisms_overwritten<<".";
+             }
+             if(group_order.empty()) {
+                 std::cout<<" Group order: not available.";
+             }
+             else {
+                 std::cout<<" Group order: "<<(group_order_exact ? "" : "at least ")<<group_order<<".";
+             }
+             if(components) {
+                 std::cout<<" Components searched: "<<components<<".";
+             }
+             if(tasks_searched) {
+                 std::cout<<" Tasks searched in parallel: "<<tasks_searched<<".";
+             }
+             if(vertices_reduced) {
+                 std::cout<<" Vertices removed by reduction: "<<vertices_reduced<<".";
+             }
+             if(vertex_invar_splits) {
+                 std::cout<<" Split by vertex invariant: "<<vertex_invar_splits<<".";
+             }
+             if(wl_splits) {
+                 std::cout<<" Split by 2-WL: "<<wl_splits<<".";
+             }
+             if(refinements_aborted) {
+                 std::cout<<" Aborted by trace: "<<refinements_aborted<<".";
+             }
+             std::cout<<" Canonical updates: " << best_leaf_updates<<". Backtracks: "<<times_backtracked
              << ". Reached level: "<<max_level<<", total tc's selected: "<<total_target_cells<<std::endl;
 }
 
+void Statistics::add(const Statistics& other) {
+    refinements_made += other.refinements_made;
+    leaves_visited += other.leaves_visited;
+    best_leaf_updates += other.best_leaf_updates;
+    num_bad_leaves += other.num_bad_leaves;
+    max_level = std::max(max_level, other.max_level);
+    num_pruned_by_auto += other.num_pruned_by_auto;
+    num_pruned_by_invar += other.num_pruned_by_invar;
+    automorphisms_found += other.automorphisms_found;
+    times_backtracked += other.times_backtracked;
+    total_target_cells += other.total_target_cells;
+    num_pruned_implicitly += other.num_pruned_implicitly;
+    leaf_table_lookups += other.leaf_table_lookups;
+    leaf_table_hits += other.leaf_table_hits;
+    refinements_aborted += other.refinements_aborted;
+    vertex_invar_splits += other.vertex_invar_splits;
+    wl_splits += other.wl_splits;
+    vertices_reduced += other.vertices_reduced;
+    components += other.components;
+    tasks_searched += other.tasks_searched;
+    automorphisms_overwritten += other.automorphisms_overwritten;
+}
+
 void Statistics::pretty_time() const{
 
     auto duration = execution_time;
@@ -51,7 +105,7 @@ Leaf::Leaf(): vertex_sequence(std::vector<unsigned int>()), leaf_perm(std::vecto
 
 
 
-Leaf::Leaf(std::vector<unsigned int> in_vertex_sequence, Permutation in_leaf_perm, std::vector<bool>  hash_val)
+Leaf::Leaf(std::vector<unsigned int> in_vertex_sequence, Permutation in_leaf_perm, Certificate  hash_val)
                          : vertex_sequence(std::move(in_vertex_sequence)), leaf_perm(std::move(in_leaf_perm)),
                            hash_of_perm_graph(std::move(hash_val)){
 
@@ -62,6 +116,40 @@ bool Leaf::undiscovered() const{
 }
 
 
+void WorkStealingQueue::push(SearchTask task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+}
+
+bool WorkStealingQueue::pop(SearchTask& task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(tasks.empty()){
+        return false;
+    }
+    task = std::move(tasks.back());
+    tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingQueue::steal(SearchTask& task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(tasks.empty()){
+        return false;
+    }
+    task = std::move(tasks.front());
+    tasks.pop_front();
+    return true;
+}
+
+
+SharedSearch::SharedSearch(unsigned int num_workers, const AutomorphismStore& automorphisms,
+                           const StabilizerChain& group)
+        : queues(num_workers), queued(0), idle_workers(0), finished(false), found_automorphisms(automorphisms),
+          num_automorphisms(automorphisms.nof_added()), automorphism_group(group){
+
+}
+
+
 unsigned int Nautyyy::get_gca_level(const std::vector<Vertex> &first_sequence, const std::vector<Vertex> &second_sequence) {
 
     for(size_t same_until = 0, max = std::min(first_sequence.size(), second_sequence.size()); same_until < max; same_until++){
@@ -87,38 +175,9 @@ Graph random_perm_of(char const* filename){
     return perm_graph(g, perm);
 }
 
-                                                               //simple/empty initialization of most fields of the class
-Nautyyy::Nautyyy(char const* filename, Options options)
-    : stats(Statistics()), opt(std::move(options)),
-    graph(options.use_random_perm_of_graph ? random_perm_of(filename): Sparse(filename)),
-      found_automorphisms(std::vector<Permutation>()), unbranched(std::vector<std::vector<Vertex>>()),
-      current_vertex_sequence(std::vector<Vertex>()), first_leaf(Leaf()), best_leaf(Leaf()),
-      max_invar_at_level(std::vector<InvarType>()){
-
-    stats.start_time = std::chrono::steady_clock::now();
-
-    if(opt.use_unit_partition){
-        current_partition = Partition(graph.nof_vertices());                              //begin with unit partition
-    }
-    else{
-        //current_partition = opt.input_partition;                                              //or user passes partition
-        if(graph.initial_partition.empty()){
-            throw std::runtime_error("No initial partition was given.");
-        }
-        current_partition = Partition(graph.initial_partition);
-        if(graph.nof_vertices() != current_partition.get_size()){
-            throw std::runtime_error("No complete initial partition was given.");
-        }
-    }
-    current_level = 1;
-    stats.max_level = 1;
-    current_partition.refinement(graph);                                                       //refine to get root node
-    stats.refinements_made++;
-    if(opt.invarmethod == Options::refinement){
-        current_partition.use_ref_invar = true;            //let partition know to create an invariant during refinement
-    }
+                                      //reads in the graph and does the same as the constructor taking the graph
+Nautyyy::Nautyyy(char const* filename, Options options) : Nautyyy(Sparse(filename), std::move(options)){
 
-    search_tree_traversal();                                                           //main function call of algorithm
 }
 
 
@@ -135,33 +194,53 @@ Graph random_perm_of(const Graph& g){
     return perm_graph(g, perm);
 }
 
-//same as other constructor but the graph is passed as graph and not as filename to read in a graph
+                                                               //simple/empty initialization of most fields of the class
 Nautyyy::Nautyyy(const Graph&  in_graph, Options options)
         : stats(Statistics()), opt(std::move(options)),
-          graph(options.use_random_perm_of_graph ? random_perm_of(in_graph): in_graph),
-          found_automorphisms(std::vector<Permutation>()), unbranched(std::vector<std::vector<Vertex>>()),
+          graph(opt.use_random_perm_of_graph ? random_perm_of(in_graph): in_graph),
+          found_automorphisms(AutomorphismStore(graph.nof_vertices(), opt.automorphism_store_size)),
+      unbranched(std::vector<std::vector<Vertex>>()),
           current_vertex_sequence(std::vector<Vertex>()), first_leaf(Leaf()), best_leaf(Leaf()),
-          max_invar_at_level(std::vector<InvarType>()){
+          max_invar_at_level(std::vector<InvarType>()),
+      max_hash_invar_at_level(std::vector<std::uint64_t>()),
+      max_trace_at_level(std::vector<std::vector<std::uint64_t>>()), leaf_table(std::unordered_map<std::uint64_t, Permutation>()),
+      orbits_at_level(std::vector<OrbitPartition>()), automorphism_group(0, {}){
 
     stats.start_time = std::chrono::steady_clock::now();
 
+    if(search_preprocessed_graph()){                       //a search on a preprocessed graph replaced ours
+        return;
+    }
+
     if(opt.use_unit_partition){
         current_partition = Partition(graph.nof_vertices());                              //begin with unit partition
     }
     else{
         //current_partition = opt.input_partition;                                              //or user passes partition
-        if(graph.initial_partition.empty()){
+        std::vector<std::vector<Vertex>> initial_partition = graph.initial_partition();
+        if(initial_partition.empty()){
             throw std::runtime_error("No initial partition was given.");
         }
-        current_partition = Partition(graph.initial_partition);
+        current_partition = Partition(initial_partition);
         if(graph.nof_vertices() != current_partition.get_size()){
             throw std::runtime_error("No complete initial partition was given.");
         }
     }
+    if((opt.vertex_invariant != Partition::no_vertex_invar or opt.max_2wl_level > 0)
+       and not ThreadPool::on_worker_thread()){
+        refinement_pool.reset(new ThreadPool());                      //started once, each node only wakes it up
+    }
     current_level = 1;
     stats.max_level = 1;
     current_partition.refinement(graph);
     stats.refinements_made++;
+    apply_stronger_refinements(current_level);
+    if(opt.invarmethod == Options::quotient){
+        current_partition.use_quotient_invar = true;
+    }
+    if(opt.invarmethod == Options::trace){
+        current_partition.use_trace = true;
+    }
     if(opt.invarmethod == Options::refinement){
         current_partition.use_ref_invar = true;
     }
@@ -170,8 +249,42 @@ Nautyyy::Nautyyy(const Graph&  in_graph, Options options)
 }
 
 
+Nautyyy::Nautyyy(const Nautyyy& main_search, SharedSearch& shared_search)
+        : stats(Statistics()), opt(main_search.opt), graph(main_search.graph), current_level(1),
+          current_partition(main_search.current_partition),
+          found_automorphisms(AutomorphismStore(graph.nof_vertices(), opt.automorphism_store_size)),
+          unbranched(std::vector<std::vector<Vertex>>()), current_vertex_sequence(std::vector<Vertex>()),
+          first_leaf(main_search.first_leaf), best_leaf(main_search.best_leaf),
+          max_invar_at_level(main_search.max_invar_at_level),
+          max_hash_invar_at_level(main_search.max_hash_invar_at_level),
+          max_trace_at_level(main_search.max_trace_at_level),
+          leaf_table(std::unordered_map<std::uint64_t, Permutation>()),
+          orbits_at_level(std::vector<OrbitPartition>()),
+          automorphism_group(0, {}), shared(&shared_search){
+
+}
+
+
 void Nautyyy::search_tree_traversal() {
 
+    if(opt.num_threads != 1){
+        search_parallel();
+    }
+    else{
+        traverse_subtree();
+    }
+    if(not first_leaf.undiscovered()){
+                       //implicit automorphisms are never found, so even a complete chain may miss some generators
+        stats.group_order_exact = automorphism_group.verify() and not opt.use_implicit_pruning;
+        stats.group_order = automorphism_group.order();
+    }
+    stats.automorphisms_overwritten = found_automorphisms.nof_overwritten();
+    report();
+}
+
+
+void Nautyyy::traverse_subtree() {
+
     while(current_level>=1) {
         if (not current_partition.is_discrete()) {
             process_node();
@@ -180,6 +293,446 @@ void Nautyyy::search_tree_traversal() {
             process_leaf();
         }
     }
+}
+
+
+bool Nautyyy::search_preprocessed_graph() {
+    if(opt.use_components){
+        std::vector<std::vector<Vertex>> components = graph.connected_components();
+        if(components.size() > 1){
+            search_components(components);                          //the search trees of the components replace ours
+            return true;
+        }
+    }
+    if(opt.use_reduction){
+        GraphReduction reduction(graph, not opt.use_unit_partition);
+        if(not reduction.is_trivial()){
+            search_reduced_graph(reduction);                          //the search tree of the reduced graph replaces ours
+            return true;
+        }
+    }
+    if(opt.use_renumbering){
+        search_renumbered_graph(graph.cuthill_mckee_order());             //the search runs on the renumbered copy
+        return true;
+    }
+    return false;
+}
+
+
+void Nautyyy::search_reduced_graph(const GraphReduction& reduction) {
+
+    Options reduced_options = opt;
+    reduced_options.use_reduction = false;
+    reduced_options.use_unit_partition = false;                          //the colors of the reduced graph are its types
+    reduced_options.use_random_perm_of_graph = false;
+    reduced_options.print_stats = false;
+    reduced_options.print_time = false;
+    Nautyyy reduced_nautyyy(reduction.reduced_graph(), reduced_options);
+
+    std::chrono::steady_clock::time_point start_time = stats.start_time;
+    stats = reduced_nautyyy.stats;
+    stats.start_time = start_time;
+    stats.vertices_reduced = reduction.nof_removed_vertices();
+    stats.group_order.clear();                                  //the order of the reduced graph's group is smaller
+    stats.group_order_exact = false;
+
+    Permutation leaf_perm = reduction.expand_labelling(reduced_nautyyy.best_leaf.leaf_perm);
+    best_leaf = Leaf({}, leaf_perm, graph.perm_hash_value(leaf_perm));
+    for(const Permutation& automorphism:
+            reduction.expand_automorphisms(reduced_nautyyy.found_automorphisms.dense_permutations())){
+        found_automorphisms.add(SparsePermutation(automorphism));
+    }
+    report();
+}
+
+
+void Nautyyy::search_renumbered_graph(const std::vector<Vertex>& order) {
+
+    Options renumbered_options = opt;
+    renumbered_options.use_renumbering = false;
+    renumbered_options.use_random_perm_of_graph = false;
+    renumbered_options.print_stats = false;
+    renumbered_options.print_time = false;
+    Nautyyy renumbered_nautyyy(graph.induced_subgraph(order), renumbered_options);
+
+    std::chrono::steady_clock::time_point start_time = stats.start_time;
+    stats = renumbered_nautyyy.stats;
+    stats.start_time = start_time;
+
+    Permutation renumbered(order.size());                                  //the number of each vertex in the copy
+    for(unsigned int i=0; i<order.size(); i++){
+        renumbered[order[i]] = i;
+    }
+    Permutation leaf_perm(graph.nof_vertices());
+    for(Vertex v=0; v<graph.nof_vertices(); v++){
+        leaf_perm[v] = renumbered_nautyyy.best_leaf.leaf_perm[renumbered[v]];
+    }
+    best_leaf = Leaf({}, leaf_perm, std::move(renumbered_nautyyy.best_leaf.hash_of_perm_graph));
+    for(const SparsePermutation& renumbered_automorphism: renumbered_nautyyy.found_automorphisms){
+        std::vector<std::pair<Vertex, Vertex>> moved;                     //only the support has to be translated
+        for(std::size_t i=0; i<renumbered_automorphism.moved_points().size(); i++){
+            moved.emplace_back(order[renumbered_automorphism.moved_points()[i]],
+                               order[renumbered_automorphism.moved_images()[i]]);
+        }
+        found_automorphisms.add(SparsePermutation(graph.nof_vertices(), std::move(moved)));
+    }
+    report();
+}
+
+
+void Nautyyy::search_components(const std::vector<std::vector<Vertex>>& components) {
+
+    Options component_options = opt;
+    component_options.use_components = false;
+    component_options.use_random_perm_of_graph = false;
+    component_options.print_stats = false;
+    component_options.print_time = false;
+    bool use_colors = not opt.use_unit_partition;
+
+    std::vector<Leaf> component_leaves(components.size());
+    std::vector<std::vector<SparsePermutation>> component_automorphisms(components.size());
+    std::vector<Statistics> component_stats(components.size());
+    std::vector<unsigned int> by_size(components.size());               //the largest components are started first
+    std::iota(by_size.begin(), by_size.end(), 0);
+    std::stable_sort(by_size.begin(), by_size.end(), [&](unsigned int a, unsigned int b){
+        return components[a].size() > components[b].size();
+    });
+    std::atomic<unsigned int> next_component(0);
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+    unsigned int num_threads = std::max(1u, std::min<unsigned int>(std::thread::hardware_concurrency(),
+                                                                    components.size()));
+    auto search = [&](){                        //with several threads searching, each component refines inline
+        std::unique_ptr<ThreadPool::WorkerScope> worker_scope(num_threads > 1 ? new ThreadPool::WorkerScope() : nullptr);
+        for(unsigned int next = next_component++; next < components.size(); next = next_component++){
+            unsigned int c = by_size[next];
+            try{
+                Nautyyy component_nautyyy(graph.induced_subgraph(components[c]), component_options);
+                component_leaves[c] = std::move(component_nautyyy.best_leaf);
+                component_automorphisms[c] = component_nautyyy.found_automorphisms.permutations();
+                component_stats[c] = component_nautyyy.stats;
+            }
+            catch(...){                                        //rethrown on the calling thread after all are joined
+                std::lock_guard<std::mutex> lock(error_mutex);
+                error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for(unsigned int t=1; t<num_threads; t++){
+        threads.emplace_back(search);
+    }
+    search();
+    for(std::thread& thread: threads){
+        thread.join();
+    }
+    if(error){
+        std::rethrow_exception(error);
+    }
+
+    std::vector<std::vector<unsigned int>> canonical_colors(components.size());        //the colors in canonical order
+    std::vector<std::vector<Vertex>> canonical_vertices(components.size());           //the vertices in canonical order
+    for(unsigned int c=0; c<components.size(); c++){
+        canonical_colors[c].resize(components[c].size(), 0);
+        canonical_vertices[c].resize(components[c].size());
+        for(unsigned int i=0; i<components[c].size(); i++){
+            unsigned int position = component_leaves[c].leaf_perm[i];
+            canonical_vertices[c][position] = components[c][i];
+            if(use_colors and graph.is_colored()){
+                canonical_colors[c][position] = graph.color(components[c][i]);
+            }
+        }
+    }
+    auto compare_components = [&](unsigned int a, unsigned int b){
+        int comparison = compare_certificates(component_leaves[a].hash_of_perm_graph,
+                                              component_leaves[b].hash_of_perm_graph);
+        return comparison != 0 ? comparison : (canonical_colors[a] < canonical_colors[b] ? -1 :
+                                              canonical_colors[a] == canonical_colors[b] ? 0 : 1);
+    };
+    std::vector<unsigned int> order(components.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+        return compare_components(a, b) < 0;
+    });
+
+    std::vector<Vertex> canonical_order;
+    canonical_order.reserve(graph.nof_vertices());
+    for(unsigned int c: order){
+        canonical_order.insert(canonical_order.end(), canonical_vertices[c].begin(), canonical_vertices[c].end());
+    }
+    if(use_colors and graph.is_colored()){                   //as in the leaves of a search on the graph itself
+        std::stable_sort(canonical_order.begin(), canonical_order.end(), [this](Vertex a, Vertex b){
+            return graph.color(a) < graph.color(b);
+        });
+    }
+    Permutation leaf_perm(graph.nof_vertices());
+    for(unsigned int i=0; i<canonical_order.size(); i++){
+        leaf_perm[canonical_order[i]] = i;
+    }
+    best_leaf = Leaf({}, leaf_perm, graph.perm_hash_value(leaf_perm));
+
+    for(unsigned int c=0; c<components.size(); c++){
+        for(const SparsePermutation& component_automorphism: component_automorphisms[c]){
+            std::vector<Vertex> support, images;                //components are sorted, so the support stays sorted
+            for(std::size_t i=0; i<component_automorphism.moved_points().size(); i++){
+                support.push_back(components[c][component_automorphism.moved_points()[i]]);
+                images.push_back(components[c][component_automorphism.moved_images()[i]]);
+            }
+            found_automorphisms.add(SparsePermutation(graph.nof_vertices(), std::move(support), std::move(images)));
+        }
+    }
+    for(unsigned int i=1; i<order.size(); i++){               //identical components are swapped position by position
+        if(compare_components(order[i-1], order[i]) == 0){
+            std::vector<std::pair<Vertex, Vertex>> moved;
+            const std::vector<Vertex>& first = canonical_vertices[order[i-1]];
+            const std::vector<Vertex>& second = canonical_vertices[order[i]];
+            for(unsigned int k=0; k<first.size(); k++){
+                moved.emplace_back(first[k], second[k]);
+                moved.emplace_back(second[k], first[k]);
+            }
+            found_automorphisms.add(SparsePermutation(graph.nof_vertices(), std::move(moved)));
+        }
+    }
+
+    for(const Statistics& component: component_stats){
+        stats.add(component);
+    }
+    stats.components = components.size();
+    report();
+}
+
+
+void Nautyyy::search_parallel() {
+
+    while(current_level>=1 and first_leaf.undiscovered()){           //the first path is searched alone, it is the base
+        if (not current_partition.is_discrete()) {
+            process_node();
+        } else {
+            stats.leaves_visited++;
+            process_leaf();
+        }
+    }
+    unsigned int num_workers = opt.num_threads ? opt.num_threads : std::max(1u, std::thread::hardware_concurrency());
+    SharedSearch shared_search(num_workers, found_automorphisms, automorphism_group);
+    unsigned int num_tasks = 0;
+    for(unsigned int level=1; level<=unbranched.size(); level++){  //pushed round robin, the deepest are popped first
+        for(Vertex child: unbranched[level-1]){
+            SearchTask task(first_leaf.vertex_sequence.begin(), first_leaf.vertex_sequence.begin() + (level-1));
+            task.push_back(child);
+            shared_search.queues[num_tasks++ % num_workers].push(std::move(task));
+        }
+    }
+    if(current_level == 0 or num_tasks == 0){                     //the first path was the whole tree, nothing is left
+        current_level = 0;
+        return;
+    }
+    shared_search.queued = num_tasks;
+    shared_search.best_leaf = best_leaf;
+    shared_search.max_invar_at_level = max_invar_at_level;
+    shared_search.max_hash_invar_at_level = max_hash_invar_at_level;
+    shared_search.max_trace_at_level = max_trace_at_level;
+    if(current_level > 1){
+        backtrack_to(1);                                                    //the workers start at the root
+    }
+
+    std::vector<std::unique_ptr<Nautyyy>> workers;
+    for(unsigned int w=0; w<num_workers; w++){
+        workers.emplace_back(new Nautyyy(*this, shared_search));
+    }
+    std::vector<std::thread> threads;
+    for(unsigned int w=1; w<num_workers; w++){
+        threads.emplace_back(&Nautyyy::work, workers[w].get(), w);
+    }
+    workers[0]->work(0);
+    for(std::thread& thread: threads){
+        thread.join();
+    }
+    if(shared_search.error){
+        std::rethrow_exception(shared_search.error);
+    }
+
+    best_leaf = shared_search.best_leaf;
+    found_automorphisms = std::move(shared_search.found_automorphisms);
+    automorphism_group = std::move(shared_search.automorphism_group);
+    for(const std::unique_ptr<Nautyyy>& worker: workers){
+        stats.add(worker->stats);
+    }
+    current_level = 0;                                                                    //the whole tree is searched
+}
+
+
+void Nautyyy::work(unsigned int worker) {
+    ThreadPool::WorkerScope worker_scope;                           //all threads search, nodes are refined inline
+    worker_index = worker;
+    unsigned int num_workers = shared->queues.size();
+    SearchTask task;
+    while(true){
+        bool found = false;
+        if(shared->queued > 0){                                           //the queues are only locked if worth it
+            found = shared->queues[worker].pop(task);
+            for(unsigned int k=1; k<num_workers and not found; k++){
+                found = shared->queues[(worker+k) % num_workers].steal(task);
+            }
+        }
+        if(not found){                          //the others are still searching and may hand off some of their work
+            std::unique_lock<std::mutex> lock(shared->idle_mutex);
+            shared->idle_workers++;
+            if(shared->idle_workers == num_workers and shared->queued == 0){
+                shared->finished = true;
+                shared->work_available.notify_all();
+            }
+            shared->work_available.wait(lock, [this]{ return shared->finished or shared->queued > 0; });
+            shared->idle_workers--;
+            if(shared->finished){
+                return;
+            }
+            continue;
+        }
+        shared->queued--;
+        try{
+            search_task(task);
+        }
+        catch(...){                                            //rethrown on the calling thread after all are joined
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if(not shared->error){
+                shared->error = std::current_exception();
+            }
+        }
+    }
+}
+
+
+void Nautyyy::search_task(const SearchTask& task) {
+    stats.tasks_searched++;
+    task_level = 1;
+    if(not current_vertex_sequence.empty()){                          //the partition is left where the last task ended
+        current_partition.reconstruct_at_level(1);
+    }
+    current_level = 1;
+    current_vertex_sequence.clear();
+    unbranched.clear();
+    if(orbits_at_level.size() > 1){                                           //only the orbits at the root stay valid
+        orbits_at_level.erase(orbits_at_level.begin() + 1, orbits_at_level.end());
+    }
+    adopt_shared_best_leaf();
+    pull_shared_automorphisms();
+    for(std::size_t i=0; i<task.size(); i++){                                //replay the path to the root of the task
+        if(i+1 == task.size() and not found_automorphisms.empty()
+           and not orbits_at(current_level).is_representative(task[i])){
+            stats.num_pruned_by_auto++;
+            return;
+        }
+        unsigned int level = current_level;
+        branch_to(task[i]);
+        if(current_level == level){                                             //pruned by the invariant of the node
+            return;
+        }
+    }
+    task_level = current_level;
+    unbranched.resize(current_level-1);                            //only the root of the task is branched on from here
+    traverse_subtree();
+}
+
+
+void Nautyyy::hand_off_children() {
+    std::vector<Vertex>& children = unbranched[current_level-1];
+    for(std::size_t i=children.size()-1; i>=1; i--){                       //the smallest children are popped first
+        SearchTask task(current_vertex_sequence);
+        task.push_back(children[i]);
+        shared->queues[worker_index].push(std::move(task));
+    }
+    shared->queued += children.size()-1;                          //counted once they are there, so they can be taken
+    {
+        std::lock_guard<std::mutex> lock(shared->idle_mutex);  //a worker about to wait sees them or gets notified
+        shared->work_available.notify_all();
+    }
+    children.resize(1);
+    task_level = current_level+1;                                        //the first child is the root of the task now
+}
+
+
+void Nautyyy::pull_shared_automorphisms() {
+    if(shared == nullptr or shared->num_automorphisms == automorphisms_seen){
+        return;
+    }
+    std::vector<SparsePermutation> new_automorphisms;
+    {
+        std::lock_guard<std::mutex> lock(shared->automorphism_mutex);
+        const AutomorphismStore& stored = shared->found_automorphisms;
+        std::size_t added = stored.nof_added();
+        for(std::size_t number = std::max(automorphisms_seen, added - stored.size()); number < added; number++){
+            new_automorphisms.push_back(stored.permutations()[stored.index_of(number)]);
+        }
+        automorphisms_seen = added;
+    }
+    for(const SparsePermutation& automorphism: new_automorphisms){
+        record_automorphism(automorphism);
+    }
+}
+
+
+void Nautyyy::publish_best_leaf() {
+    if(shared == nullptr){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    int compared = compare_max_invariants(shared->max_invar_at_level, shared->max_hash_invar_at_level,
+                                          shared->max_trace_at_level);
+    if(compared > 0 or (compared == 0 and
+                        compare_certificates(best_leaf.hash_of_perm_graph, shared->best_leaf.hash_of_perm_graph) > 0)){
+        shared->best_leaf = best_leaf;
+        shared->max_invar_at_level = max_invar_at_level;
+        shared->max_hash_invar_at_level = max_hash_invar_at_level;
+        shared->max_trace_at_level = max_trace_at_level;
+    }
+}
+
+
+void Nautyyy::adopt_shared_best_leaf() {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    int compared = compare_max_invariants(shared->max_invar_at_level, shared->max_hash_invar_at_level,
+                                          shared->max_trace_at_level);
+    if(compared < 0 or (compared == 0 and
+                        compare_certificates(best_leaf.hash_of_perm_graph, shared->best_leaf.hash_of_perm_graph) < 0)){
+        best_leaf = shared->best_leaf;
+        max_invar_at_level = shared->max_invar_at_level;
+        max_hash_invar_at_level = shared->max_hash_invar_at_level;
+        max_trace_at_level = shared->max_trace_at_level;
+        best_leaf_outdated_due_to_invariant = false;
+    }
+}
+
+
+/*
+ * compare_common_levels(first, second)
+ *
+ * Returns: The lexicographic comparison of the maximal invariants first and second on the levels both have, as a
+ *          negative number, 0 or a positive number
+ */
+template<typename Invar>
+static int compare_common_levels(const std::vector<Invar>& first, const std::vector<Invar>& second){
+    for(std::size_t level=0; level<first.size() and level<second.size(); level++){
+        if(first[level] != second[level]){
+            return first[level] < second[level] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+int Nautyyy::compare_max_invariants(const std::vector<InvarType>& invar, const std::vector<std::uint64_t>& hash_invar,
+                                    const std::vector<std::vector<std::uint64_t>>& trace) const {
+    int compared = compare_common_levels(max_invar_at_level, invar);          //at most one of them is used at a time
+    if(compared == 0){
+        compared = compare_common_levels(max_hash_invar_at_level, hash_invar);
+    }
+    if(compared == 0){
+        compared = compare_common_levels(max_trace_at_level, trace);
+    }
+    return compared;
+}
+
+
+void Nautyyy::report() {
 
     std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
     stats.execution_time = (end_time-stats.start_time);
@@ -198,6 +751,7 @@ void Nautyyy::search_tree_traversal() {
 
 void Nautyyy::process_node(){
 
+    pull_shared_automorphisms();                          //the automorphisms of the other workers prune as well
                  //first encounter of this node, get target cell but don't prune yet since we explore first child anyway
     if(unbranched.size() < current_level){
         CellStruct target_cell(0, 0, 0);
@@ -223,18 +777,21 @@ void Nautyyy::process_node(){
                 unbranched.back().erase(unbranched.back().begin()+1, unbranched.back().end());
             }
         }
+        if(shared != nullptr and current_level == task_level and unbranched.back().size() > 1
+           and shared->idle_workers > 0){
+            hand_off_children();
+        }
     }
                              //only prune at second encounter, i.e. exists target cell and first child has been explored
     else if(not found_automorphisms.empty()){
         std::vector<Vertex>& current_unbranched = unbranched[current_level-1];
-        std::vector<Vertex> unbranched_after_pruning{};
-        std::vector<Vertex> current_mcrs = mcrs(found_automorphisms, current_vertex_sequence);
-                                                  //prune target cell. set_intersect works since both vectors are sorted
-        std::set_intersection(current_unbranched.begin(),  current_unbranched.end(),
-                              current_mcrs.begin(),current_mcrs.end(), std::back_inserter(unbranched_after_pruning));
-        stats.num_pruned_by_auto += (current_unbranched.size() - unbranched_after_pruning.size());
-        current_unbranched = unbranched_after_pruning;
-        }
+        OrbitPartition& orbits = orbits_at(current_level);
+                                                    //prune target cell, only the smallest vertex of an orbit remains
+        auto pruned = std::remove_if(current_unbranched.begin(), current_unbranched.end(),
+                                     [&orbits](Vertex v){return not orbits.is_representative(v);});
+        stats.num_pruned_by_auto += (current_unbranched.end() - pruned);
+        current_unbranched.erase(pruned, current_unbranched.end());
+    }
 
     std::vector<Vertex>& current_unbranched = unbranched[current_level-1];
 
@@ -245,71 +802,206 @@ void Nautyyy::process_node(){
 
     Vertex child = current_unbranched.front();  //choose first/smallest element of target cell/ first unbranched element
     current_unbranched.erase(current_unbranched.begin());                 //element will be branched upon now, remove it
+    branch_to(child);
+}
+
+void Nautyyy::branch_to(Vertex child) {
     current_vertex_sequence.push_back(child);
+    if(opt.invarmethod == Options::trace){            //the child is compared with the greatest trace of its level
+        current_partition.compare_trace = max_trace_at_level.size() >= current_level
+                                          ? &max_trace_at_level[current_level-1] : nullptr;
+    }
     current_partition.split_by_and_refine(graph, child);                                //get refined partition of split
     stats.refinements_made++;
+    if(not current_partition.trace_aborted){
+        apply_stronger_refinements(current_level+1);                                       //the child is one level deeper
+    }
 
     prune_by_invar();
 }
 
+void Nautyyy::apply_stronger_refinements(unsigned int level) {
+    if(opt.vertex_invariant != Partition::no_vertex_invar and level >= opt.min_vertex_invar_level
+                                                         and level <= opt.max_vertex_invar_level){
+        if(current_partition.refine_by_vertex_invariant(graph, opt.vertex_invariant, refinement_pool.get())){
+            stats.vertex_invar_splits++;
+        }
+    }
+    if(level <= opt.max_2wl_level and not current_partition.trace_aborted){
+        if(current_partition.refine_by_2wl(graph, refinement_pool.get())){
+            stats.wl_splits++;
+        }
+    }
+}
+
 void Nautyyy::process_leaf() {
 
     Permutation leaf_perm = discrete_partition_to_perm(current_partition);
-    std::vector<bool> hash_val = graph.perm_hash_value(leaf_perm);
 
     if(current_level > stats.max_level){
         stats.max_level = current_level;
     }
 
     if(first_leaf.undiscovered()){                                                              //first encountered leaf
-        first_leaf = Leaf(current_vertex_sequence, leaf_perm, hash_val);
+        first_leaf = Leaf(current_vertex_sequence, leaf_perm, graph.perm_hash_value(leaf_perm));
+        automorphism_group = StabilizerChain(graph.nof_vertices(), current_vertex_sequence);   //the first path is a base
         best_leaf = first_leaf;
         backtrack_to(current_level-1);
         return;
     }
-                                                               //otherwise compare leaf to first_found_leaf or best_leaf
                                                              //there has been a new maximum invariant, update best guess
-    if(best_leaf_outdated_due_to_invariant  or hash_val > best_leaf.hash_of_perm_graph){
-        best_leaf = Leaf(current_vertex_sequence, leaf_perm, hash_val);      //update best canonical node
+    if(best_leaf_outdated_due_to_invariant){
+        best_leaf = Leaf(current_vertex_sequence, leaf_perm, graph.perm_hash_value(leaf_perm));
         stats.best_leaf_updates++;
-        backtrack_to(current_level-1);
         best_leaf_outdated_due_to_invariant=false;
+        publish_best_leaf();
+        backtrack_to(current_level-1);
         return;
     }
+                                                               //otherwise compare leaf to first_found_leaf or best_leaf
+                                     //without building its certificate, most leaves differ early on from both of them
+    std::vector<int> comparison = graph.compare_perm_hash_value(leaf_perm,
+                                  {&first_leaf.hash_of_perm_graph, &best_leaf.hash_of_perm_graph});
+    int compared_to_first = comparison[0];
+    int compared_to_best = comparison[1];
 
-     if(hash_val == first_leaf.hash_of_perm_graph){                  //leaves are equivalent, this gives an automorphism
-        Permutation automorphism = perm_composition(first_leaf.leaf_perm, perm_inverse(leaf_perm));
-        found_automorphisms.push_back(automorphism);
-        stats.automorphisms_found++;
-                                                                        //backtrack to level of greatest common ancestor
-        //backtrack_to(get_gca_level(first_leaf.vertex_sequence, current_vertex_sequence));
+    if(compared_to_best > 0){                                   //only now the certificate of the leaf is needed in full
+        best_leaf = Leaf(current_vertex_sequence, leaf_perm, graph.perm_hash_value(leaf_perm));//update best canonical node
+        stats.best_leaf_updates++;
+        publish_best_leaf();
         backtrack_to(current_level-1);
         return;
     }
-     else if(hash_val == best_leaf.hash_of_perm_graph){                                         //same but for best leaf
-         Permutation automorphism = perm_composition(best_leaf.leaf_perm, perm_inverse(leaf_perm));
-         found_automorphisms.push_back(automorphism);
-         stats.automorphisms_found++;
-         //backtrack_to(get_gca_level(best_leaf.vertex_sequence, current_vertex_sequence));
-         backtrack_to(current_level-1);
+
+     if(compared_to_first == 0){                                     //leaves are equivalent, this gives an automorphism
+        add_automorphism(perm_composition(first_leaf.leaf_perm, perm_inverse(leaf_perm)));
+                        //the automorphism maps the rest of the subtree below the greatest common ancestor onto the
+                        //already explored one of first_leaf, so it is skipped, see Theorem 2.33 in McKay (1981)
+        backtrack_to(opt.use_backjump ? get_gca_level(first_leaf.vertex_sequence, current_vertex_sequence)
+                                      : current_level-1);
+        return;
+    }
+     else if(compared_to_best == 0){                                                            //same but for best leaf
+         add_automorphism(perm_composition(best_leaf.leaf_perm, perm_inverse(leaf_perm)));
+                  //in parallel only if best_leaf lies in the current task: the tasks only change hands before their
+                  //first leaf, so its subtrees below the common ancestor are searched by this worker and before
+         bool best_leaf_in_task = shared == nullptr or (best_leaf.vertex_sequence.size() >= task_level-1
+                 and std::equal(current_vertex_sequence.begin(), current_vertex_sequence.begin() + (task_level-1),
+                                best_leaf.vertex_sequence.begin()));
+         backtrack_to(opt.use_backjump and best_leaf_in_task
+                      ? get_gca_level(best_leaf.vertex_sequence, current_vertex_sequence) : current_level-1);
          return;
      }
-                                        //that we got here means hash_val < first or best leaf, do nothing but backtrack
-     stats.num_bad_leaves++;
+                         //that we got here means leaf < first or best leaf, but it may be equivalent to another leaf
+     if(opt.leaf_table_size){
+         std::uint64_t fingerprint = graph.perm_fingerprint(leaf_perm);
+         stats.leaf_table_lookups++;
+         auto found = leaf_table.find(fingerprint);
+         if(found != leaf_table.end()){         //same fingerprint, only now compare with the certificate of that leaf
+             Certificate found_hash = graph.perm_hash_value(found->second);
+             if(graph.compare_perm_hash_value(leaf_perm, {&found_hash})[0] == 0){
+                 add_automorphism(perm_composition(found->second, perm_inverse(leaf_perm)));
+                 stats.leaf_table_hits++;
+                 backtrack_to(current_level-1);
+                 return;
+             }
+         }
+         else if(leaf_table.size() < opt.leaf_table_size){
+             leaf_table.emplace(fingerprint, leaf_perm);
+         }
+     }
+     stats.num_bad_leaves++;                                                       //do nothing but backtrack
      backtrack_to(current_level-1);
 }
 
 
 
+void Nautyyy::add_automorphism(const Permutation& automorphism) {
+    stats.automorphisms_found++;
+    if(shared != nullptr){                  //sifted once for all workers, each records it when pulling it from there
+        {
+            std::lock_guard<std::mutex> lock(shared->automorphism_mutex);
+            shared->found_automorphisms.add(SparsePermutation(automorphism));
+            shared->automorphism_group.add_generator(automorphism);
+            shared->num_automorphisms = shared->found_automorphisms.nof_added();
+        }
+        pull_shared_automorphisms();
+        return;
+    }
+    record_automorphism(SparsePermutation(automorphism));
+    automorphism_group.add_generator(automorphism);
+}
+
+
+void Nautyyy::record_automorphism(const SparsePermutation& automorphism) {
+    found_automorphisms.add(automorphism);
+    unsigned int fixed = 0;                                 //the length of the prefix of the vertex sequence it fixes
+    while(fixed < current_vertex_sequence.size()
+          and automorphism.image(current_vertex_sequence[fixed]) == current_vertex_sequence[fixed]){
+        fixed++;
+    }
+    for(unsigned int level = 1; level <= orbits_at_level.size() and level-1 <= fixed; level++){
+        orbits_at_level[level-1].add_permutation(automorphism);
+    }
+}
+
+
+OrbitPartition& Nautyyy::orbits_at(unsigned int level) {
+                                                  //on the path to first_leaf the vertex sequence is part of the base
+    if(level-1 <= first_leaf.vertex_sequence.size() and std::equal(current_vertex_sequence.begin(),
+            current_vertex_sequence.begin() + (level-1), first_leaf.vertex_sequence.begin())){
+        if(shared == nullptr){
+            return automorphism_group.orbits_at(level-1);
+        }
+        if(shared_group_orbits.size() < level){
+            shared_group_orbits.resize(level, OrbitPartition(0));
+            shared_group_orbits_version.resize(level, std::numeric_limits<std::size_t>::max());      //not copied yet
+        }
+        std::lock_guard<std::mutex> lock(shared->automorphism_mutex);
+        std::size_t version = shared->automorphism_group.strong_generators().size();
+        if(shared_group_orbits_version[level-1] != version){
+            shared_group_orbits[level-1] = shared->automorphism_group.orbits_at(level-1);
+            shared_group_orbits_version[level-1] = version;
+        }
+        return shared_group_orbits[level-1];
+    }
+    while(orbits_at_level.size() < level){
+        std::vector<Vertex> sequence(current_vertex_sequence.begin(),
+                                     current_vertex_sequence.begin() + orbits_at_level.size());
+        OrbitPartition orbits(graph.nof_vertices());
+        for(std::size_t k=0; k<found_automorphisms.size(); k++){
+            if(found_automorphisms.fixes(k, sequence)){
+                found_automorphisms.add_to_orbits(k, orbits);
+            }
+        }
+        std::unique_lock<std::mutex> lock;                        //a worker reads the chain shared by all of them
+        if(shared != nullptr){
+            lock = std::unique_lock<std::mutex>(shared->automorphism_mutex);
+        }
+        const StabilizerChain& group = shared == nullptr ? automorphism_group : shared->automorphism_group;
+        for(const Permutation& generator: group.strong_generators()){             //cover overwritten automorphisms
+            if(is_fixed(generator, sequence)){
+                orbits.add_permutation(generator);
+            }
+        }
+        orbits_at_level.push_back(std::move(orbits));
+    }
+    return orbits_at_level[level-1];
+}
+
+
 void Nautyyy::backtrack_to(unsigned int level) {
     stats.times_backtracked++;
-    if(level==0){                                                         //handles the case of the algorithm being done
-        current_level = level;                           //sets level to 0 so while loop in search_tree_traversal() ends
+    if(level < task_level){                                     //handles the case of the algorithm or task being done
+        current_level = 0;                                //sets level to 0 so while loop in traverse_subtree() ends
         return;
     }
     current_partition.reconstruct_at_level(level);                               //get old partition at the wanted level
     current_vertex_sequence.resize(level-1);       //return to old vertex sequence, simply remove later vertices
     unbranched.resize(level);                                     //later unbranched do not matter anymore, new path now
+    if(orbits_at_level.size() > level){                  //the orbits up to level still fix the same vertex sequence
+        orbits_at_level.erase(orbits_at_level.begin() + level, orbits_at_level.end());
+    }
     current_level = level;
 }
 
@@ -317,6 +1009,24 @@ void Nautyyy::backtrack_to(unsigned int level) {
 
 void Nautyyy::prune_by_invar() {
 
+    if(opt.invarmethod == Options::quotient){                //a single hash, compared without building any vector
+        std::uint64_t new_invar = current_partition.is_discrete() ? std::numeric_limits<std::uint64_t>::max()
+                                                                  : current_partition.quotient_invar;
+        compare_invar(new_invar, max_hash_invar_at_level);
+        return;
+    }
+    if(opt.invarmethod == Options::trace){
+        if(current_partition.trace_aborted){          //refinement already found the trace to be smaller, so prune it
+            current_partition.reconstruct_at_level(current_level);
+            current_vertex_sequence.pop_back();
+            stats.num_pruned_by_invar++;
+            stats.refinements_aborted++;
+            return;
+        }
+                                 //leaves are not made greatest here, a refinement may be aborted before it is discrete
+        compare_invar(current_partition.trace, max_trace_at_level);
+        return;
+    }
     InvarType new_invar{};
     if(current_partition.is_discrete() and (not (opt.invarmethod==Options::none))){
         new_invar.push_back(std::numeric_limits<int>::max());            //assert that leaves are considered as greatest
@@ -335,25 +1045,34 @@ void Nautyyy::prune_by_invar() {
             case Options::num_cells:
                 new_invar = InvarType{current_partition.number_of_cells()};
                 break;
+            case Options::quotient:
+            case Options::trace:
+                break;
         }
     }
+    compare_invar(new_invar, max_invar_at_level);
+}
+
+
+template<typename Invar>
+void Nautyyy::compare_invar(const Invar& new_invar, std::vector<Invar>& max_at_level) {
                            //comparing of invariant. This is pruning method Pa and assures that a canonical node remains
-    if(max_invar_at_level.size() < current_level){                   //has there been an invariant on this level before?
-        if(max_invar_at_level.size() != current_level-1){
+    if(max_at_level.size() < current_level){                         //has there been an invariant on this level before?
+        if(max_at_level.size() != current_level-1){
             throw std::runtime_error("There are not as many invar's as there should be.");
         }
-        max_invar_at_level.push_back(new_invar);             //if not, this is automatically new max invar at this level
+        max_at_level.push_back(new_invar);                   //if not, this is automatically new max invar at this level
         current_level++;
         return;
     }
-    else if(new_invar == max_invar_at_level[current_level-1]) {
+    else if(new_invar == max_at_level[current_level-1]) {
         current_level++;                                    //invar does not tell us anything, further explore this path
         return;
     }
-    else if(new_invar > max_invar_at_level[current_level-1]){//invar found is better than any found before on this level
-        max_invar_at_level[current_level-1] = new_invar;
+    else if(new_invar > max_at_level[current_level-1]){      //invar found is better than any found before on this level
+        max_at_level[current_level-1] = new_invar;
                                      //reset the max invariant values following after, since everything is lexicographic
-        max_invar_at_level.resize(current_level);
+        max_at_level.resize(current_level);
                                                              //update the next leaf encountered to be the new best guess
         best_leaf_outdated_due_to_invariant = true;
         current_level++;
@@ -363,6 +1082,7 @@ void Nautyyy::prune_by_invar() {
     else {
         //smaller invariant, don't further explore this child and reconstruct previous partition
         current_partition.reconstruct_at_level(current_level);
+        current_vertex_sequence.pop_back();                               //the child is not part of the path anymore
         stats.num_pruned_by_invar++;
         return;
     }
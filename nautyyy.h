@@ -19,10 +19,19 @@
 #include<algorithm>
 #include<numeric>
 #include <random>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+#include <memory>
 
 #include "sparse_graph.h"
 #include "partition and refinement.h"
 #include "permutation group.h"
+#include "graph_reduction.h"
 
 /*
  * Self-explanatory typedefs of certain types.
@@ -38,8 +47,12 @@ using Vertex = unsigned int;
  * Statistics
  * Purpose: Used as a field in Nautyyy to store various info accumulated during the execution of the algorithm.
  *
- * The member variables and their purpose/represented data are obvious from their name.
+ * The member variables and their purpose/represented data are obvious from their name. group_order is the order of
+ * the group generated by the found automorphisms as a decimal number, only known after a search on the graph itself
+ * and not after one on a reduced graph or on the components. group_order_exact is set if the stabilizer chain passed
+ * the deterministic Schreier test and no implicit automorphisms were skipped, otherwise group_order is a lower bound
  * print(): Outputs and describes most fields of the struct in a simple way.
+ * add(other): Adds the counts of other to these, e.g. of the searches of several components
  * pretty_time(): Outputs the time it took the algorithm to finish in a human readable format
  *                It should be mentioned that time is measured without time it takes to read in the graph or copy it
  */
@@ -55,9 +68,21 @@ struct Statistics{
     unsigned int times_backtracked = 0;
     unsigned int total_target_cells = 0;
     unsigned int num_pruned_implicitly = 0;
+    unsigned int leaf_table_lookups = 0;
+    unsigned int leaf_table_hits = 0;
+    unsigned int refinements_aborted = 0;
+    unsigned int vertex_invar_splits = 0;
+    unsigned int wl_splits = 0;
+    unsigned int vertices_reduced = 0;
+    unsigned int components = 0;
+    unsigned int tasks_searched = 0;
+    unsigned int automorphisms_overwritten = 0;
+    std::string group_order;
+    bool group_order_exact = false;
     std::chrono::steady_clock::time_point start_time;
     std::chrono::duration<double> execution_time;
     void print() const;
+    void add(const Statistics& other);
     void pretty_time() const;
 };
 
@@ -70,6 +95,10 @@ struct Statistics{
  *              shape is the invariant of a vector of the cell sizes of a partition
  *              refinement consists of info collected during refinement, here: all sizes of ocurring shattered cells
  *              num_cells is just the number of cells in the current partition
+ *              quotient is a 64 bit hash of the degrees between cells seen during refinement, see partition and
+ *              refinement.h. Unlike the others it is compared in constant time and without allocating
+ *              trace is the sequence of the events making up quotient, compared with the greatest trace of the level
+ *              while refining. A refinement that falls below is stopped early and the node pruned right away
  * targetcellmethod: determines what target cell is selected, for further info see partition and refinement.h
  *                   reminder: options are first, first_smallest and joins
  * explore_first_path: A consideration is to not prune by node invariant while exploring the first path (first child of
@@ -81,10 +110,35 @@ struct Statistics{
  * max_level_tc: Should be used very optionally, allows one specify a level until which a second
  *               (stronger but more costly) target cell selector should be use
  * strong_targetcellmethod: specifies the optionally used stronger selector
+ * vertex_invariant: A vertex invariant to split the nodes further after refining them, for graphs on which refinement
+ *                   alone is weak. For the choices see refine_by_vertex_invariant in partition and refinement.h
+ * min_vertex_invar_level, max_vertex_invar_level: The levels of the nodes it is applied to, the root is at level 1
+ * max_2wl_level: The nodes up to this level are split by 2-dimensional Weisfeiler-Leman refinement after the vertex
+ *                invariant, see refine_by_2wl in partition and refinement.h. 0 disables it, 1 means only the root
+ * leaf_table_size: How many leaves at most are kept in the leaf table of Nautyyy to find automorphisms also with
+ *                  leaves other than first_leaf and best_leaf. 0 disables the table
+ * automorphism_store_size: How many automorphisms at most are kept in found_automorphisms, see AutomorphismStore in
+ *                          permutation group.h. Further ones overwrite the oldest. Every automorphism is still added
+ *                          to the orbits kept at that time and sifted into the stabilizer chain, whose strong
+ *                          generators are used for the orbits as well. 0 keeps all of them. The bound covers only
+ *                          the store: the chain keeps its strong generators as well, as full permutations with
+ *                          their inverses. These are only automorphisms that enlarged the group, so there are at most
+ *                          log2 of the group order of them for each base point
+ * use_backjump: Whether a leaf equivalent to first_leaf or best_leaf backtracks to the greatest common ancestor of the
+ *               two instead of its parent, see process_leaf in Nautyyy. Only disabled to check the backjump against
+ *               the plain search, as backjump_stress.cpp does
+ * use_reduction: Whether pendant trees and twins are removed from the graph first, see graph_reduction.h. The search
+ *                tree is then traversed on the smaller reduced graph and its result expanded to the graph
+ * use_components: Whether a disconnected graph is split into its connected components. Each of them is searched on its
+ *                 own, in parallel, and identical components are swapped by automorphisms given directly
+ * use_renumbering: Whether the search runs on a copy of the graph renumbered in reverse Cuthill-McKee order, which keeps
+ *                  neighbors close in memory. Only the locality changes, the results are translated back
+ * num_threads: How many threads traverse the search tree, see search_parallel in Nautyyy. 1 searches sequentially and
+ *              0 uses one thread per core. The certificate of best_leaf is the same for any number of threads
  *
  */
 struct Options{
-    enum InvarMethod {none, shape, refinement, num_cells};
+    enum InvarMethod {none, shape, refinement, num_cells, quotient, trace};
     InvarMethod invarmethod = shape;
     Partition::TargetcellMethod targetcellmethod = Partition::first;
     bool use_unit_partition = true;
@@ -95,6 +149,17 @@ struct Options{
     Partition::TargetcellMethod strong_targetcellmethod = Partition::joins;
     bool use_implicit_pruning = false;
     bool use_random_perm_of_graph = false;
+    unsigned int leaf_table_size = 1024;
+    unsigned int automorphism_store_size = 1024;
+    bool use_backjump = true;
+    Partition::VertexInvariant vertex_invariant = Partition::no_vertex_invar;
+    unsigned int min_vertex_invar_level = 1;
+    unsigned int max_vertex_invar_level = 1;
+    unsigned int max_2wl_level = 0;
+    bool use_reduction = false;
+    bool use_components = false;
+    bool use_renumbering = false;
+    unsigned int num_threads = 1;
 };
 
 
@@ -104,7 +169,7 @@ struct Options{
  *
  * vertex_sequence: An ordered list of vertices indicating which child was chosen at which level to get to leaf
  * leaf_perm: The partition corresponding to the discrete partition of the leaf
- * hash_of_perm_graph: The associated hash value of the graph after permuting by leaf_perm
+ * hash_of_perm_graph: The associated certificate of the graph after permuting by leaf_perm
  *
  * Leaf(): an 'empty' Leaf, has all member variables default initialized
  * Leaf(in_vertex_sequence, in_leaf_perm, hash_val): Constructs a Leaf with the given values for the variables
@@ -113,14 +178,87 @@ struct Options{
 struct Leaf{
     std::vector<unsigned int> vertex_sequence;
     Permutation leaf_perm;
-    std::vector<bool> hash_of_perm_graph;
+    Certificate hash_of_perm_graph;
     Leaf();
-    Leaf(std::vector<unsigned int> in_vertex_sequence, Permutation  in_leaf_perm, std::vector<bool>  hash_val);
+    Leaf(std::vector<unsigned int> in_vertex_sequence, Permutation  in_leaf_perm, Certificate  hash_val);
     bool undiscovered() const;
 };
 
 
 
+/*
+ * SearchTask
+ * Purpose: A subtree of the search tree left for a worker of a parallel search, given by the vertex sequence of its
+ * root
+ */
+using SearchTask = std::vector<Vertex>;
+
+/*
+ * WorkStealingQueue
+ * Purpose: The tasks of one worker of a parallel search. The worker itself pushes and pops them at the back, so it goes
+ * through its own subtrees depth first, while idle workers steal from the front, where the tasks closest to the root
+ * and so the largest subtrees wait. A single mutex guards both ends, the tasks are coarse enough for that
+ *
+ * push(task): Adds task at the back
+ * pop(task), steal(task): Take a task from the back or the front into task. Return false if there was none
+ */
+class WorkStealingQueue{
+    std::deque<SearchTask> tasks;
+    std::mutex mutex;
+public:
+    void push(SearchTask task);
+    bool pop(SearchTask& task);
+    bool steal(SearchTask& task);
+};
+
+/*
+ * SharedSearch
+ * Purpose: What the workers of a parallel search share, see search_parallel in Nautyyy
+ *
+ * queues: one WorkStealingQueue for each worker
+ * queued: the number of tasks waiting in the queues. A worker only looks for one while this is not 0
+ * idle_workers: the number of workers that found no task, the others then hand off parts of their subtrees
+ * idle_mutex, work_available: idle workers wait on work_available until tasks are queued or the search is finished
+ * finished: set once all workers are idle and no task is queued, since then none can be pushed anymore
+ * automorphism_mutex: guards found_automorphisms and automorphism_group
+ * found_automorphisms: the automorphisms found by any worker, as many as Options::automorphism_store_size allows. Each
+ *                      worker copies the ones new to it into its own found_automorphisms and orbits before it prunes
+ *                      a node, a worker that fell behind by more than the store keeps misses the overwritten ones
+ * num_automorphisms: found_automorphisms.nof_added(), read without the lock to see whether there are new ones
+ * automorphism_group: the stabilizer chain of all automorphisms, with the vertex sequence of first_leaf as base. The
+ *                     worker finding an automorphism sifts it, once for all workers, and the workers take the orbits
+ *                     on the path to first_leaf from it
+ * mutex: guards everything below
+ * best_leaf: the greatest leaf published by any worker
+ * max_invar_at_level, max_hash_invar_at_level, max_trace_at_level: the node invariants on the path to best_leaf.
+ *                                                                  Leaves are ordered by these first and by their
+ *                                                                  certificates second, as the sequential search does
+ * error: the first exception thrown by a worker, rethrown once all are joined
+ *
+ * SharedSearch(num_workers, automorphisms, group): The shared state of that many workers, without any tasks, starting
+ *                                                with the automorphisms and the stabilizer chain of the first path
+ */
+struct SharedSearch{
+    std::vector<WorkStealingQueue> queues;
+    std::atomic<unsigned int> queued;
+    std::atomic<unsigned int> idle_workers;
+    std::mutex idle_mutex;
+    std::condition_variable work_available;
+    bool finished;
+    std::mutex automorphism_mutex;
+    AutomorphismStore found_automorphisms;
+    std::atomic<std::size_t> num_automorphisms;
+    StabilizerChain automorphism_group;
+    std::mutex mutex;
+    Leaf best_leaf;
+    std::vector<InvarType> max_invar_at_level;
+    std::vector<std::uint64_t> max_hash_invar_at_level;
+    std::vector<std::vector<std::uint64_t>> max_trace_at_level;
+    std::exception_ptr error;
+    SharedSearch(unsigned int num_workers, const AutomorphismStore& automorphisms, const StabilizerChain& group);
+};
+
+
 /*
  * Nautyyy
  * Purpose: Class that manages the high-level execution of the Algorithm to calculate a canonical isomorph/labelling
@@ -142,6 +280,29 @@ struct Leaf{
  * best_leaf: The so far best discovered guess for a leaf giving a  canonical isomorph is saved and updated here
  * max_invar_at_level: A vector of InvarType's to store the greatest invar found at each level. Since the ordering is
  *                     lexikographic, we erase all invars after the current level if a new greatest has been found
+ * max_hash_invar_at_level: The same as max_invar_at_level for the 64 bit invariant of Options::quotient
+ * max_trace_at_level: The same for the traces of Options::trace, the refinement of a child compares against these
+ * leaf_table: Maps the fingerprints of leaves that were neither equivalent to first_leaf nor to best_leaf to their
+ *             leaf_perm. A later leaf with the same fingerprint is compared to it in full and if they are equivalent,
+ *             that gives an automorphism. Holds at most opt.leaf_table_size leaves
+ * orbits_at_level: For the levels of the current path up to the deepest node revisited so far, the orbits of the
+ *                  found automorphisms fixing the vertex sequence up to that level pointwise. New automorphisms are
+ *                  added to them right away and backtracking cuts off the levels whose vertex sequence changes
+ * automorphism_group: A stabilizer chain of the found automorphisms with the vertex sequence of first_leaf as base. On
+ *                     the path to first_leaf it gives the exact orbits of the stabilizers, which may be larger than
+ *                     the ones of orbits_at_level, and at the end the order of the automorphism group. Workers of a
+ *                     parallel search leave it empty and use the one in shared
+ * shared_group_orbits: For a worker, copies of the orbits of shared->automorphism_group on the path to first_leaf,
+ *                      taken when the chain had shared_group_orbits_version strong generators. A copy is renewed once
+ *                      the chain has more, so the lock is not held while a node is pruned
+ * shared: If this is a worker of a parallel search, the state it shares with the other workers, otherwise nullptr
+ * task_level: The level of the root of the subtree being searched, backtracking above it ends the search. This is 1
+ *             unless this is a worker searching a task
+ * automorphisms_seen: How many of the automorphisms in shared have been pulled into this search already
+ * worker_index: The index of this worker in shared, its own tasks are in shared->queues[worker_index]
+ * refinement_pool: The threads the vertex invariant and 2-dimensional Weisfeiler-Leman refinement run on, started once
+ *                  for the whole search if either is used. nullptr for the workers of a parallel search, which
+ *                  already occupy the threads, so they refine on their own thread
  *
  * Auxiliary boolean variables:
  * best_leaf_outdated_due_to_invariant: found new max invariant so next encountered leaf will be next max
@@ -156,14 +317,15 @@ struct Leaf{
  *
  */
 class Nautyyy{
+public:
+    Statistics stats;                                           //public, e.g. for the leaf counts of a stress test
 private:
-    Statistics stats;
     const Options opt;
     const Graph graph;
     unsigned int current_level;
     Partition current_partition;
 public:
-    PermGroup found_automorphisms;                                   //public, if one is interested in the automorphisms
+    AutomorphismStore found_automorphisms;                           //public, if one is interested in the automorphisms
 private:
     std::vector<std::vector<Vertex>> unbranched;
     std::vector<Vertex> current_vertex_sequence;
@@ -172,6 +334,18 @@ public:
     Leaf best_leaf;                                         //public, since this best leaf gives the canonical labelling
 private:
     std::vector<InvarType> max_invar_at_level;
+    std::vector<std::uint64_t> max_hash_invar_at_level;
+    std::vector<std::vector<std::uint64_t>> max_trace_at_level;
+    std::unordered_map<std::uint64_t, Permutation> leaf_table;
+    std::vector<OrbitPartition> orbits_at_level;
+    StabilizerChain automorphism_group;
+    std::vector<OrbitPartition> shared_group_orbits;
+    std::vector<std::size_t> shared_group_orbits_version;
+    SharedSearch* shared = nullptr;
+    unsigned int task_level = 1;
+    std::size_t automorphisms_seen = 0;
+    unsigned int worker_index = 0;
+    std::unique_ptr<ThreadPool> refinement_pool;
 
     bool best_leaf_outdated_due_to_invariant = false;
 
@@ -183,15 +357,30 @@ private:
      * At each point in the algorithm there is a node represented via current_partition and current_vertex_sequence
      * This function then, while the search tree is not completely traversed yet, either calls
      * process_node or process_node if the node is a leaf.
+     * With opt.num_threads other than 1, the tree is traversed by search_parallel instead.
      */
     void search_tree_traversal();
+    /*
+     * traverse_subtree()
+     *
+     * The loop of search_tree_traversal: processes nodes and leaves until the search backtracks above task_level
+     */
+    void traverse_subtree();
+    /*
+     * branch_to(child)
+     *
+     * Goes from the current node to its child split by the vertex child, refines it and prunes it by its invariant,
+     * see prune_by_invar
+     */
+    void branch_to(Vertex child);
     /*
      * process_node()
      *
      * Handles the particulars of encountering a node.
      * Specifically, gets a target cell or takes the unbranched on that level, prunes this set with the help of found
-     * automorphisms if any bay taking the intersect with mcrs. When there is an unbranched und not pruned element left,
-     * take the first/earliest element and split the partition by that vertex, creating the corresponding child node.
+     * automorphisms if any by keeping the representatives of their orbits, see orbits_at_level. When there is an
+     * unbranched und not pruned element left, take the first/earliest element and split the partition by that vertex,
+     * creating the corresponding child node.
      * Finally it manages the specified node invariant of that child node and if possible pruning via the node invariant
      */
     void process_node();
@@ -205,15 +394,60 @@ private:
      * is handled separately in process_node().
      */
     void prune_by_invar();
+    /*
+     * compare_invar(new_invar, max_at_level)
+     *
+     * The comparison in prune_by_invar() for either kind of invariant, new_invar of the current node against the
+     * maximal ones found at each level in max_at_level. Goes to the next level, possibly updating the maximum, or
+     * prunes the current node.
+     */
+    template<typename Invar>
+    void compare_invar(const Invar& new_invar, std::vector<Invar>& max_at_level);
+    /*
+     * apply_stronger_refinements(level)
+     *
+     * Splits current_partition, a node at the given level, further by opt.vertex_invariant and by 2-dimensional
+     * Weisfeiler-Leman refinement if the level lies in the ranges set in opt
+     */
+    void apply_stronger_refinements(unsigned int level);
     /*
      * process_leaf()
      *
      * Handles the particulars of encountering a leaf
      * Specifically, if it is the first leaf encountered, save it. Then, if we know that leaf is a better guess for the
      * canonical isomorph/labelling, update that. If the leaf is equivalent to either first_leaf or best_leaf that
-     * gives us an automorphism of the graph which we add to found_automorphisms
+     * gives us an automorphism of the graph which we add to found_automorphisms, and the search jumps back to the
+     * greatest common ancestor of the two leaves: the automorphism maps what is left of the current subtree below it
+     * onto the explored one of the other leaf. A worker of a parallel search only jumps back from a leaf equivalent to
+     * best_leaf if best_leaf lies in its current task, whose subtrees only it searches, in order. Otherwise the leaf
+     * is looked up in leaf_table by its fingerprint, which may give an automorphism as well, and is inserted if it is
+     * new
      */
     void process_leaf();
+    /*
+     * add_automorphism(automorphism)
+     *
+     * Stores an automorphism found at the current leaf in found_automorphisms, adds it to the orbits of each level
+     * whose vertex sequence it fixes and sifts it into automorphism_group. A worker of a parallel search stores and
+     * sifts it in shared instead and records it when it pulls it from there, as the ones of the others
+     */
+    void add_automorphism(const Permutation& automorphism);
+    /*
+     * record_automorphism(automorphism)
+     *
+     * The part of add_automorphism kept by every search: stores automorphism in found_automorphisms and adds it to the
+     * orbits of each level whose vertex sequence it fixes
+     */
+    void record_automorphism(const SparsePermutation& automorphism);
+    /*
+     * orbits_at(level)
+     *
+     * Returns: The orbits of the found automorphisms fixing the vertex sequence up to level. On the path to first_leaf
+     *          these are the exact ones of automorphism_group, or of shared->automorphism_group for a worker,
+     *          otherwise the ones of orbits_at_level. The orbits of levels not kept yet are built from the stored
+     *          automorphisms and the strong generators of the chain, once per node
+     */
+    OrbitPartition& orbits_at(unsigned int level);
     /*
      * backtrack_to(level)
      *
@@ -225,6 +459,115 @@ private:
      * Thus we return to a previous node.
      */
     void backtrack_to(unsigned int level);
+    /*
+     * search_preprocessed_graph()
+     *
+     * Runs the preprocessing modes enabled in opt, in the order components, reduction and renumbering. The first one
+     * that applies to graph searches in place of the search tree of graph, see the three functions below.
+     * Returns: Whether such a search was done, in which case the constructor is finished
+     */
+    bool search_preprocessed_graph();
+    /*
+     * search_reduced_graph(reduction)
+     *
+     * Instead of traversing the search tree of graph, traverses the one of the reduced graph of reduction with the
+     * same options and expands its best_leaf and found_automorphisms to ones of graph. The statistics are the ones
+     * of that traversal
+     */
+    void search_reduced_graph(const GraphReduction& reduction);
+    /*
+     * search_components(components)
+     *
+     * Instead of traversing the search tree of graph, traverses the ones of its connected components on a pool of
+     * threads, each with the same options. The components are ordered by their certificates and colors, which makes
+     * identical ones neighbors, and best_leaf places them in that order, each labelled by its own best_leaf.
+     * found_automorphisms are the ones of the components plus the swaps of neighboring identical components
+     */
+    void search_components(const std::vector<std::vector<Vertex>>& components);
+    /*
+     * search_renumbered_graph(order)
+     *
+     * Instead of traversing the search tree of graph, traverses the one of graph renumbered so that order[i] becomes
+     * vertex i, with the same options, and translates its best_leaf and found_automorphisms back to graph
+     */
+    void search_renumbered_graph(const std::vector<Vertex>& order);
+    /*
+     * report()
+     *
+     * Measures the execution time and prints the statistics and the time if set in opt
+     */
+    void report();
+    /*
+     * search_parallel()
+     *
+     * Traverses the search tree with opt.num_threads workers, each a Nautyyy of its own sharing a SharedSearch. The
+     * first path is searched alone, its leaf is the first_leaf of all workers. The unexplored children along it become
+     * the first tasks, dealt out round robin. A worker that runs out of tasks steals the one closest to the root from
+     * another or else waits, and while some wait the others hand off all but the first child of their task roots.
+     * Pruning by automorphisms and by node invariants is as in the sequential search. The workers pull each other's
+     * automorphisms before pruning a node, and a worker starting a task takes over the shared best leaf and its
+     * invariants if they are greater than its own. Every automorphism is sifted once, into the stabilizer chain in
+     * shared. Backjumping to the greatest common ancestor is done with first_leaf, and with best_leaf if it lies in the
+     * task being searched, see process_leaf. At the end best_leaf is the greatest leaf of all workers, which gives the
+     * same certificate as the sequential search, and found_automorphisms and automorphism_group are the shared ones
+     */
+    void search_parallel();
+    /*
+     * work(worker)
+     *
+     * The loop of a worker with index worker: searches its own tasks and stolen ones. Without any, it waits until
+     * tasks are handed off or all workers are idle, which ends the search
+     */
+    void work(unsigned int worker);
+    /*
+     * search_task(task)
+     *
+     * Replays the path from the root to the root of task, which prunes the task if a node on it is pruned by its
+     * invariant or if its last vertex is not the representative of its orbit, and then searches the subtree below
+     */
+    void search_task(const SearchTask& task);
+    /*
+     * hand_off_children()
+     *
+     * Pushes all but the first child of the current node, the root of the task being searched, as tasks of their own
+     * and makes that first child the root instead
+     */
+    void hand_off_children();
+    /*
+     * pull_shared_automorphisms()
+     *
+     * Records the automorphisms stored in shared since the last call, see record_automorphism
+     */
+    void pull_shared_automorphisms();
+    /*
+     * publish_best_leaf()
+     *
+     * Replaces the best leaf in shared by best_leaf if it is greater
+     */
+    void publish_best_leaf();
+    /*
+     * adopt_shared_best_leaf()
+     *
+     * Takes over the best leaf in shared and its invariants if they are greater than best_leaf. Only done between
+     * tasks, since the current path was compared with the old invariants
+     */
+    void adopt_shared_best_leaf();
+    /*
+     * compare_max_invariants(invar, hash_invar, trace)
+     *
+     * Returns: Whether the maximal invariants of this search are smaller than, equal to or greater than the given ones,
+     *          as a negative number, 0 or a positive number. Only the levels both have are compared, as compare_invar
+     *          does when a path is longer than the one of the maximal invariants
+     */
+    int compare_max_invariants(const std::vector<InvarType>& invar, const std::vector<std::uint64_t>& hash_invar,
+                               const std::vector<std::vector<std::uint64_t>>& trace) const;
+    /*
+     * Nautyyy(main_search, shared)
+     *
+     * A worker of the parallel search of main_search. It starts at the root of main_search, with its first_leaf,
+     * best_leaf and invariants, and does not search anything until work is called
+     */
+    Nautyyy(const Nautyyy& main_search, SharedSearch& shared);
 
 
 public:
@@ -234,7 +577,7 @@ public:
      *
      * Constructs a class object, mainly with most things default initialised but handles root node and employs some
      * settings given in opt. Depending on which constructor is used, the graph is copied to Nautyyy or is read in
-     * for that purpose via adjacency_matrix(filename).
+     * for that purpose via Sparse(filename), after which the filename constructor delegates to the other one.
      * Then it calls search_tree_traversal() and the main algorithm begins.
      */
     explicit Nautyyy(char const* filename, Options options = Options{});
@@ -1,5 +1,8 @@
 #include "partition and refinement.h"
 
+#include <unordered_map>
+#include <mutex>
+
 
 CellStruct::CellStruct(unsigned int input_first, unsigned int input_length, unsigned int input_in_level)             //simply initialise the fields
         :first(input_first), length(input_length), in_level(input_in_level){
@@ -9,102 +12,116 @@ bool CellStruct::operator==(const CellStruct &rhs) const {     //two CellStructs
     return (first == rhs.first and length == rhs.length and in_level == rhs.in_level);
 }
 
-Partition::Partition(): element_vec(std::vector<Vertex>()), lcs(std::list<CellStruct>()),
-    in_cell(std::vector<std::list<CellStruct>::iterator>()), non_singleton(std::list<std::list<CellStruct>::iterator>()),
-    level(0), refinement_stacks(std::vector<std::stack<unsigned int>>()) {
-                                                                                            //init everything to nothing
+Partition::Partition(): element_vec(std::vector<Vertex>()), cells(std::vector<CellStruct>()),
+    in_cell(std::vector<unsigned int>()), next_non_singleton(std::vector<unsigned int>(1, 0)),
+    prev_non_singleton(std::vector<unsigned int>(1, 0)), num_cells(0), num_non_singleton(0),
+    degree_count(), touched_in_cell(), touched_cells(), degree_start(1), fragment_sizes(), fragment_degrees(),
+    sort_buffer(), invariant_values(), next_splitter(std::vector<unsigned int>(1, 0)), last_splitter(0), in_splitter_queue(),
+    level(0), trail(), trail_elements(), trail_level_start() {
+                                                                 //init everything to nothing, only the empty list head
 }
 
 
 Partition::Partition(unsigned int n): element_vec(std::vector<Vertex>(n)),//unit partition, n elements, a single cell of size one
-                             lcs(std::list<CellStruct>(1, CellStruct(0, n, 1))),
-                                      non_singleton(std::list<std::list<CellStruct>::iterator>()){  //init non_singleton as empty
+                             cells(std::vector<CellStruct>(n, CellStruct(0, n, 1))),
+                             in_cell(std::vector<unsigned int>(n, 0)),                 //every element is in the same cell
+                             next_non_singleton(std::vector<unsigned int>(n+1, n)),  //init non_singleton as empty
+                             prev_non_singleton(std::vector<unsigned int>(n+1, n)), num_cells(1), num_non_singleton(0),
+                             degree_count(n, 0), touched_in_cell(n, 0), touched_cells(), degree_start(n+1, 0),
+                             fragment_sizes(), fragment_degrees(), sort_buffer(n), next_splitter(n+1, n),
+                             last_splitter(n), in_splitter_queue(n, false){
     if(n<1){
         throw std::runtime_error("Partition must be of positive size");
     }
     std::iota(element_vec.begin(), element_vec.end(), 0);              //element_vec simply is 0,1,...,n
-    in_cell = std::vector<std::list<CellStruct>::iterator>(n, lcs.begin());    //every element is in the same cell
     if(n>1) {
-        non_singleton.push_back(lcs.begin());
+        link_non_singleton(0, n);
     }
 
 
     level = 0;                                          //Partition before first refinement is not used in tree, level 0
-    refinement_stacks = std::vector<std::stack<unsigned int>>();
 }
 
-Partition::Partition(const std::vector<std::vector<Vertex>> &other_format_partition)
-                        :non_singleton(std::list<std::list<CellStruct>::iterator>()){      //init non_singleton as empty
+Partition::Partition(const std::vector<std::vector<Vertex>> &other_format_partition): num_cells(0), num_non_singleton(0){
                                                                               //sum the sizes of cells to get total size
     int n = std::accumulate(other_format_partition.begin(), other_format_partition.end(),
                             0, []( int sum, const std::vector<Vertex>& cell){return sum+cell.size();});
     element_vec = std::vector<Vertex>(n);                                                                   //n elements
-    in_cell = std::vector<std::list<CellStruct>::iterator>(n);
+    cells = std::vector<CellStruct>(n, CellStruct(0, 0, 0));
+    in_cell = std::vector<unsigned int>(n);
+    next_non_singleton = std::vector<unsigned int>(n+1, n);                                //init non_singleton as empty
+    prev_non_singleton = std::vector<unsigned int>(n+1, n);
+    degree_count = std::vector<unsigned int>(n, 0);
+    touched_in_cell = std::vector<unsigned int>(n, 0);
+    degree_start = std::vector<unsigned int>(n+1, 0);
+    sort_buffer = std::vector<Vertex>(n);
+    next_splitter = std::vector<unsigned int>(n+1, n);
+    last_splitter = n;
+    in_splitter_queue = std::vector<bool>(n, false);
     int temp_first = 0;
+    unsigned int last_non_singleton = n;
     for(const std::vector<Vertex>& cell: other_format_partition){         //construct the cells from the integer vectors
         std::copy(cell.begin(), cell.end(), element_vec.begin()+temp_first);              //and assign element_vec
-        lcs.emplace_back(temp_first, cell.size(), 1);           //construct and place new CellStruct into lcs
-        temp_first += cell.size();
+        cells[temp_first] = CellStruct(temp_first, cell.size(), 1);                  //construct and place new CellStruct
+        num_cells++;
         for(int element: cell){                                    //update in_cell for the elements of the current cell
-            in_cell[element] = std::prev(lcs.end(),1);
+            in_cell[element] = temp_first;
         }
         if(cell.size()>1){
-            non_singleton.push_back(std::prev(lcs.end(),1));
+            link_non_singleton(temp_first, last_non_singleton);
+            last_non_singleton = temp_first;
         }
+        temp_first += cell.size();
     }
 
 
     level = 0;                                          //Partition before first refinement is not used in tree, level 0
-    refinement_stacks = std::vector<std::stack<unsigned int>>();
 }
 
 
-Partition::Partition(const Partition& old)
-                    :non_singleton(std::list<std::list<CellStruct>::iterator>()){          //init non_singleton as empty
-        element_vec = old.element_vec;                                //simply copy first two fields element_vec and lcs
-        lcs = old.lcs;
-        in_cell = std::vector<std::list<CellStruct>::iterator>(element_vec.size());
-        for(auto it=lcs.begin(); it!=lcs.end(); it++) {
-            for (auto element = element_vec.begin() + it->first;
-                 element != element_vec.begin() + it->first + it->length; element++) {
-                                                   //the iterators of in_cell do not update to now point to the elements
-                                                      //of the new element_vec, the iterators are correctly set manually
-                in_cell[*element] = it;
-            }
-            if (it->length > 1) {                                   //also extract non-singleton cells and set iterators
-                non_singleton.push_back(it);
-            }
-        }
-        level = old.level;                                                                    //also copy backtrack data
-        refinement_stacks = old.refinement_stacks;
+void Partition::link_non_singleton(unsigned int cell, unsigned int after){
+    next_non_singleton[cell] = next_non_singleton[after];
+    prev_non_singleton[cell] = after;
+    prev_non_singleton[next_non_singleton[after]] = cell;
+    next_non_singleton[after] = cell;
+    num_non_singleton++;
 }
 
-Partition& Partition::operator=(const Partition& rhs){   //same as copy constructor but returns the new copied partition
-    if(this!=&rhs) {
-        non_singleton = std::list<std::list<CellStruct>::iterator>();                      //init non_singleton as empty
-        element_vec = rhs.element_vec;
-        lcs = rhs.lcs;
-        in_cell = std::vector<std::list<CellStruct>::iterator>(element_vec.size());
-        for(auto it=lcs.begin(); it!=lcs.end(); it++){
-            for(auto element=element_vec.begin()+it->first;
-                element!=element_vec.begin()+it->first+it->length; element++) {
-                in_cell[*element] = it;
-            }
-            if(it->length>1){                                       //also extract non-singleton cells and set iterators
-                non_singleton.push_back(it);
-            }
-        }
-        level = rhs.level;                                                                    //also copy backtrack data
-        refinement_stacks = rhs.refinement_stacks;
+void Partition::unlink_non_singleton(unsigned int cell){
+    next_non_singleton[prev_non_singleton[cell]] = next_non_singleton[cell];
+    prev_non_singleton[next_non_singleton[cell]] = prev_non_singleton[cell];
+    num_non_singleton--;
+}
+
+void Partition::queue_splitter(unsigned int cell, unsigned int after){
+    next_splitter[cell] = next_splitter[after];
+    next_splitter[after] = cell;
+    if(last_splitter == after){
+        last_splitter = cell;
+    }
+    in_splitter_queue[cell] = true;
+}
+
+void Partition::queue_splitter(unsigned int cell){
+    queue_splitter(cell, last_splitter);
+}
+
+unsigned int Partition::pop_splitter(){
+    unsigned int cell = next_splitter[get_size()];
+    next_splitter[get_size()] = next_splitter[cell];
+    if(last_splitter == cell){
+        last_splitter = get_size();
     }
-    return *this;
+    in_splitter_queue[cell] = false;
+    return cell;
 }
 
 
 
 void Partition::print() const{
     std::cout<<"[";
-    for(auto cell: lcs){                              //for each CellStruct print the elements of the cell in a nice way
+    for(unsigned int first=0; first<get_size(); first+=cells[first].length){    //print each cell in a nice way
+        const CellStruct& cell = cells[first];
         std::cout<<"[";
         for(unsigned int i=0; i<cell.length-1; i++){
             std::cout << element_vec[cell.first+i] << ",";
@@ -114,36 +131,30 @@ void Partition::print() const{
 }
 
 void Partition::print_detail() const{
-    std::cout<<"[";
-    for(auto cell: lcs){                              //for each CellStruct print the elements of the cell in a nice way
-        std::cout<<"[";
-        for(unsigned int i=0; i<cell.length-1; i++){
-            std::cout << element_vec[cell.first+i] << ",";
-        }
-        std::cout << element_vec[cell.first+cell.length-1] << "]";
-    }std::cout<<"]"<<std::endl;
+    print();
     for(int i: element_vec){               //additionally output to each element the in_level value of the cell it is in
-        std::cout<<in_cell[i]->in_level<<", ";
+        std::cout<<cells[in_cell[i]].in_level<<", ";
     }std::cout<<"\nLevel of partition: "<<level<<std::endl;
-    std::cout<<"Stack size: "<<refinement_stacks.size()<<std::endl;
+    std::cout<<"Trail size: "<<trail.size()<<std::endl;
     for(int i: element_vec){               //additionally output to each element the in_level value of the cell it is in
-        std::cout<<in_cell[i]->first<<", ";
+        std::cout<<in_cell[i]<<", ";
     }std::cout<<" as first values"<<std::endl;
 }
 
 void Partition::print_non_singleton() const{
     std::cout<<"[";
-    for(auto cell: non_singleton){      //for each CellStruct larger than 1 print the elements of the cell in a nice way
+    for(unsigned int first=next_non_singleton[get_size()]; first!=get_size(); first=next_non_singleton[first]){
+        const CellStruct& cell = cells[first];   //for each CellStruct larger than 1 print the elements in a nice way
         std::cout<<"[";
-        for(unsigned int i=0; i<cell->length-1; i++){
-            std::cout << element_vec[cell->first+i] << ",";
+        for(unsigned int i=0; i<cell.length-1; i++){
+            std::cout << element_vec[cell.first+i] << ",";
         }
-        std::cout << element_vec[cell->first+cell->length-1] << "]";
+        std::cout << element_vec[cell.first+cell.length-1] << "]";
     }std::cout<<"]"<<std::endl;
 }
 
 bool Partition::is_discrete() const{
-    return non_singleton.empty();
+    return num_non_singleton == 0;
 }
 
 unsigned int Partition::get_size() const {
@@ -151,15 +162,15 @@ unsigned int Partition::get_size() const {
 }
 
 unsigned int Partition::number_of_cells() const{
-    return lcs.size();
+    return num_cells;
 }
 
 unsigned int Partition::number_of_non_singleton_cells() const{
-    return non_singleton.size();
+    return num_non_singleton;
 }
 
 Vertex Partition::get_first_of_cell(const unsigned int &element) const{
-    return in_cell[element]->first;
+    return in_cell[element];
 }
 
 std::vector<Vertex> Partition::decode_given_cell(const CellStruct& cell) const{
@@ -168,281 +179,679 @@ std::vector<Vertex> Partition::decode_given_cell(const CellStruct& cell) const{
 }
 
 
-std::vector<std::vector<int>> Partition::decomposition(
-                              const Graph& graph,const std::vector<int>& cell_v, const std::vector<int>& cell_w)  {
-    if(cell_v.size() == 1){
+unsigned int Partition::sort_cell_by_degrees(const CellStruct& cell) {
+
+    if(cell.length == 1){
         throw std::runtime_error("A cell of size 1 cannot be decomposed.");
     }
-    std::map<int, std::vector<int>> temp{};
-    for(const int& element: cell_v){
-        temp[graph.degree(element, cell_w)].push_back(element);       //put each element into the vector of it's degree
+    unsigned int min_degree = std::numeric_limits<unsigned int>::max();
+    unsigned int max_degree = 0;
+    for(unsigned int i=cell.first; i<cell.first+cell.length; i++){
+        min_degree = std::min(min_degree, degree_count[element_vec[i]]);
+        max_degree = std::max(max_degree, degree_count[element_vec[i]]);
+    }
+    fragment_sizes.clear();
+    fragment_degrees.clear();
+    if(min_degree == max_degree){
+        fragment_sizes.push_back(cell.length);                                 //all the same degree, nothing to split
+        fragment_degrees.push_back(min_degree);
+        return 1;
     }
-    std::vector<std::vector<int>> decomposition;
-    for(const auto& element: temp){
-        decomposition.push_back(element.second);
+                                     //counting sort, the range of degrees is bounded by the work done counting them
+    std::fill(degree_start.begin(), degree_start.begin()+(max_degree-min_degree+1), 0);
+    for(unsigned int i=cell.first; i<cell.first+cell.length; i++){
+        degree_start[degree_count[element_vec[i]]-min_degree]++;
+    }
+    unsigned int position = cell.first;
+    for(unsigned int degree=0; degree<=max_degree-min_degree; degree++){      //turn counts into positions of the groups
+        unsigned int count = degree_start[degree];
+        if(count){
+            fragment_sizes.push_back(count);
+            fragment_degrees.push_back(degree+min_degree);
+        }
+        degree_start[degree] = position;
+        position += count;
     }
-    return decomposition;
+    for(unsigned int i=cell.first; i<cell.first+cell.length; i++){   //stable, elements keep their order within a group
+        Vertex element = element_vec[i];
+        sort_buffer[degree_start[degree_count[element]-min_degree]++] = element;
+    }
+    return fragment_sizes.size();
 }
 
-std::vector<std::vector<unsigned int>>
-Partition::sp_decomposition(const std::vector<unsigned int> &cell, std::map<unsigned int, unsigned int> &all_degrees) {
 
-    if(cell.size() == 1){
-        throw std::runtime_error("A cell of size 1 cannot be decomposed.");
+//as given in (2013) with my chosen data structure for Partitions
+void Partition::refinement(const Graph& graph) {
+    if(last_splitter == get_size()){                 //when no splitter has been queued, use all cells of the partition
+        for(unsigned int first=0; first<get_size(); first+=cells[first].length){
+            queue_splitter(first);
+        }
     }
+    refine_splitters(graph, level+1);
+    level++;                                   //refinement is done, partition now for the next (or first) level in tree
+}
 
-    std::vector<std::vector<unsigned int>> decomposition;
-
-    std::map<unsigned int, std::vector<unsigned int>> temp{};
-    for (const unsigned int &element: cell) {
-        temp[all_degrees[element]].push_back(element);          //put each element into the vector of it's degree
+void Partition::refine_splitters(const Graph& graph, unsigned int new_level) {
+    while((not is_discrete()) and (last_splitter != get_size()) and (not trace_aborted)){
+                                                                //get and remove the first cell of the splitter queue
+                                                        //get the vertices that are represented by the chosen CellStruct
+        const CellStruct cell_w = cells[pop_splitter()];
+                        //count the degrees into W used in decomposing cells later, and which non singleton cells they hit
+                                 //splits keep the elements of W inside its range, so it can be read again for the reset
+        for(unsigned int i=cell_w.first; i<cell_w.first+cell_w.length; i++){ //for all elements of W get all neighbors
+            for(Vertex neighbor: graph.neighbors(element_vec[i])){      //and so find the degree of neighbor vertices into W
+                if(degree_count[neighbor]++ == 0 and cells[in_cell[neighbor]].length > 1
+                                                 and touched_in_cell[in_cell[neighbor]]++ == 0){
+                    touched_cells.push_back(in_cell[neighbor]);
+                }
+            }
+        }
+                        //only cells with a neighbor in W can be split. Visit them in the order of the partition as the
+                       //non_singleton list would so the order of splits stays canonical, at most one per neighbor of W
+        std::sort(touched_cells.begin(), touched_cells.end());
+        for(unsigned int cell_index: touched_cells){
+            const CellStruct cell = cells[cell_index];        //copy, the fragments of the cell will overwrite its entry
+                                                                  //Now decompose the cell by relation to the other cell
+            unsigned int num_fragments = sort_cell_by_degrees(cell);
+            if(level and (use_quotient_invar or use_trace)) {  //the degrees from W into the cell, split or not
+                std::uint64_t event = mix_hash(std::uint64_t(cell_w.first) << 32 | cell.first);
+                for(unsigned int fragment=0; fragment<num_fragments; fragment++){
+                    event = mix_hash(event ^
+                                   (std::uint64_t(fragment_degrees[fragment]) << 32 | fragment_sizes[fragment]));
+                }
+                quotient_invar = mix_hash(quotient_invar ^ event);
+                if(use_trace and not extend_trace(event)){        //below the best node of the level, stop right here
+                    reset_splitter_buffers(graph, cell_w);
+                    trace_aborted = true;
+                    break;
+                }
+            }
+            if (num_fragments == 1) {continue;}                               //if there is no decomposition, do nothing
+            split_cell(cell, num_fragments, new_level);
+        }
+        if(not trace_aborted){                     //when aborted, the buffers were already reset before stopping
+            reset_splitter_buffers(graph, cell_w);                                         //reset them for the next W
+        }
     }
-    for (const auto &element: temp) {
-        decomposition.push_back(element.second);
+    while(last_splitter != get_size()){          //partition may be discrete or aborted early, empty the queue anyway
+        pop_splitter();
     }
-    return decomposition; //need to return iterators to neighbor cells in some way too
 }
 
-
-//as given in (2013) with my chosen data structure for Partitions
-void Partition::refinement(const Graph& graph, std::list<CellStruct> subsequence) {
-    if(subsequence.empty()){                              //when no subsequence is given, use all cells of the partition
-        subsequence = lcs;
+void Partition::split_cell(const CellStruct& cell, unsigned int num_fragments, unsigned int new_level) {
+    unsigned int cell_index = cell.first;
+    if(not trail_level_start.empty()) {            //store the cell before it is split, making later backtracking possible
+        record_split(cell);
     }
-    while((not is_discrete()) and (not subsequence.empty())){
-                                                        //get (and later remove) the first cell of the given subsequence
-                                                        //get the vertices that are represented by the chosen CellStruct
-        std::vector<Vertex> decode_cell_w = decode_given_cell(subsequence.front());
-        subsequence.erase(subsequence.begin());
-        //if(not is_sorted(decode_cell_w.begin(), decode_cell_w.end())){
-            //std::sort(decode_cell_w.begin(), decode_cell_w.end());
-            //! I want to get rid of this sort. I might get rid of this since I don't use degree anymore?
-            //std::cout<<"Slight mishap"<<std::endl;
-        //}
-                                                         //create the vector all_degress used in decomposing cells later
-        std::map<unsigned int, unsigned int> all_degrees{};
-        for(int w: decode_cell_w){                                             //for all elements of W get all neighbors
-            for(Vertex neighbor: graph.vertices[w].edges){          //and so find the degree of neighbor vertices into W
-                all_degrees[neighbor]+=1;
+    std::copy(sort_buffer.begin()+cell.first, sort_buffer.begin()+cell.first+cell.length,
+              element_vec.begin()+cell.first);                                     //update the element_vec in one go
+                                                                                      //otherwise: check some conditions
+                                                   //check if current cell of the partition is also in the splitter queue
+    bool cell_in_subsequence = in_splitter_queue[cell_index];
+    unsigned int first_largest_splitter = num_fragments;
+    if (not cell_in_subsequence) {
+        first_largest_splitter = std::distance(fragment_sizes.begin(),
+                                  std::max_element(fragment_sizes.begin(), fragment_sizes.end()));
+    }
+
+    unsigned int first = cell.first;                                                       //update pi and the subsequence
+    unsigned int last_non_singleton = prev_non_singleton[cell_index];
+    unlink_non_singleton(cell_index);                                //the fragments take the place of the cell in there
+    num_cells--;
+    for (unsigned int splitter=0; splitter<num_fragments; splitter++) {
+        unsigned int splitter_size = fragment_sizes[splitter];
+                                   //create a new cell at new_level, size of the splitter and corresponding first field
+                                                           //in place of the current cell, the first one overwrites it
+        CellStruct& new_cell = cells[first] = CellStruct(first, splitter_size, new_level);
+        num_cells++;
+        for (unsigned int i=first; i<first+splitter_size; i++) {
+            in_cell[element_vec[i]] = first;                                                         //update in_cell
+        }
+        if(splitter_size>1){                                                                      //update non_singleton
+            link_non_singleton(first, last_non_singleton);
+            last_non_singleton = first;
+        }
+        first += splitter_size;
+                                                                                                    //update subsequence
+        if (cell_in_subsequence) {                                        //replace the cell by the splitters one by one
+            if(splitter){                                //the first one takes the place of the cell, being at its index
+                queue_splitter(new_cell.first, new_cell.first - fragment_sizes[splitter-1]);
             }
         }
-                                                                     //iterate over non singleton cells of the partition
-        for(auto cell_it = non_singleton.begin();cell_it!=non_singleton.end(); cell_it++){
+        else if (splitter !=first_largest_splitter) {                      //or add all but one of the largest splitters
+            queue_splitter(new_cell.first);
+        }
+                                             //store info about process to use as an invariant, the refinement invariant
+        if(level and use_ref_invar) {
+            ref_invar.push_back(splitter_size);
+        }
+    }
+}
+
+/*
+ * min_vertices_per_thread
+ * A vertex invariant is computed on a single thread for fewer vertices than this, on more threads only if each of them
+ * gets at least this many vertices, so waking the threads pays off
+ */
+const std::size_t min_vertices_per_thread = 32;
+const unsigned int no_distance = std::numeric_limits<unsigned int>::max();
 
+/*
+ * max_cellquads_cell_size
+ * cellquads takes O(k^3) quadruples per vertex of a cell of size k, so it skips larger cells
+ */
+const unsigned int max_cellquads_cell_size = 64;
 
-              std::list<CellStruct>::iterator cell = *cell_it;       //get the iterator in lcs of the non-singleton cell
-                                                                //as above, get vertices represented by the current cell
-            std::vector<Vertex> decode_cell = decode_given_cell(*cell);
+/*
+ * run_in_parts(pool, count, compute)
+ *
+ * Calls compute(begin, end) on parts of [0, count) on the threads of pool, see ThreadPool::run, or compute(0, count)
+ * on the calling thread if pool is nullptr
+ */
+void run_in_parts(ThreadPool* pool, std::size_t count, const std::function<void(std::size_t, std::size_t)>& compute){
+    if(pool == nullptr){
+        compute(0, count);
+    }
+    else{
+        pool->run(count, min_vertices_per_thread, compute);
+    }
+}
 
-            if (std::all_of(decode_cell.begin(), decode_cell.end(),
-                    [&all_degrees](int vertex){return all_degrees.count(vertex)==0;})){
-                continue;                                 //the cell is not a neighbor cell of cell_w, it won't be split
+/*
+ * distance_invariant(graph, in_cell, vertex, distance, queue)
+ * adjtriang_invariant(graph, in_cell, vertex, mark)
+ * triples_invariant(graph, cell_begin, cell_end, vertex, mark, common)
+ * cellquads_invariant(graph, cell_begin, cell_end, vertex, parity)
+ *
+ * The values of the vertex invariants of refine_by_vertex_invariant for a single vertex. The other parameters are
+ * scratch buffers of a thread, distance is no_distance and mark and parity zero everywhere before and after a call.
+ * The contributions of the single vertices or pairs are hashed and summed up, so their order does not matter
+ */
+std::uint64_t distance_invariant(const Graph& graph, const std::vector<unsigned int>& in_cell, Vertex vertex,
+                                 std::vector<unsigned int>& distance, std::vector<Vertex>& queue){
+    std::uint64_t value = 0;
+    queue.assign(1, vertex);
+    distance[vertex] = 0;
+    for(std::size_t head=0; head<queue.size(); head++){                         //breadth first search from vertex
+        Vertex current = queue[head];
+        for(Vertex neighbor: graph.neighbors(current)){
+            if(distance[neighbor] == no_distance){
+                distance[neighbor] = distance[current] + 1;
+                value += mix_hash(std::uint64_t(distance[neighbor]) << 32 | in_cell[neighbor]);
+                queue.push_back(neighbor);
             }
+        }
+    }
+    for(Vertex visited: queue){
+        distance[visited] = no_distance;
+    }
+    return value;
+}
 
+std::uint64_t adjtriang_invariant(const Graph& graph, const std::vector<unsigned int>& in_cell, Vertex vertex,
+                                  std::vector<unsigned int>& mark){
+    std::uint64_t value = 0;
+    for(Vertex neighbor: graph.neighbors(vertex)){
+        mark[neighbor] = 1;
+    }
+    for(Vertex neighbor: graph.neighbors(vertex)){                  //count the triangles on each edge of the vertex
+        unsigned int common_neighbors = 0;
+        for(Vertex second: graph.neighbors(neighbor)){
+            common_neighbors += mark[second];
+        }
+        value += mix_hash(std::uint64_t(in_cell[neighbor]) << 32 | common_neighbors);
+    }
+    for(Vertex neighbor: graph.neighbors(vertex)){
+        mark[neighbor] = 0;
+    }
+    return value;
+}
 
-                                                                  //Now decompose the cell by relation to the other cell
-             std::vector<std::vector<unsigned int>> vk_decomposition = sp_decomposition(decode_cell, all_degrees);
-            if (vk_decomposition.size() == 1) {continue;}                     //if there is no decomposition, do nothing
-                                                                                      //otherwise: check some conditions
-                                                     //check if current cell of the partition is also in the subsequence
-            bool cell_in_subsequence = false;
-            auto pos_in_subsequence = std::find(subsequence.begin(), subsequence.end(), *cell);
-            std::vector<unsigned int> first_largest_splitter{};
-            if ((not subsequence.empty()) and pos_in_subsequence != subsequence.end()) {
-                cell_in_subsequence = true;
-            } else {
-                first_largest_splitter = *std::max_element(vk_decomposition.begin(), vk_decomposition.end(),
-                        [](const std::vector<unsigned int> &cell_a,const std::vector<unsigned int> &cell_b) {
-                                                               return cell_a.size() < cell_b.size();});
+std::uint64_t triples_invariant(const Graph& graph, const Vertex* cell_begin, const Vertex* cell_end, Vertex vertex,
+                                std::vector<unsigned int>& mark, std::vector<Vertex>& common){
+    std::uint64_t value = 0;
+    for(Vertex neighbor: graph.neighbors(vertex)){
+        mark[neighbor] = 1;
+    }
+    for(const Vertex* w=cell_begin; w!=cell_end; w++){
+        if(*w == vertex){
+            continue;
+        }
+        common.clear();                                             //the common neighbors of vertex and w, marked by 2
+        for(Vertex neighbor: graph.neighbors(*w)){
+            if(mark[neighbor]){
+                common.push_back(neighbor);
+                mark[neighbor] = 2;
+            }
+        }
+        for(const Vertex* x=w+1; x!=cell_end; x++){
+            if(*x == vertex){
+                continue;
             }
+            unsigned int adjacent_to_all = 0;
+            for(Vertex neighbor: graph.neighbors(*x)){
+                adjacent_to_all += (mark[neighbor] == 2);
+            }
+            value += mix_hash(adjacent_to_all);
+        }
+        for(Vertex neighbor: common){
+            mark[neighbor] = 1;
+        }
+    }
+    for(Vertex neighbor: graph.neighbors(vertex)){
+        mark[neighbor] = 0;
+    }
+    return value;
+}
 
-            unsigned int first = cell->first;                                                     //update pi and the subsequence
-            for (const std::vector<unsigned int> &splitter: vk_decomposition) {
-                                      //create a new cell at level+1, size of the splitter and corresponding first field
-                                                                  //and emplace it into position before the current cell
-                auto new_cell_it = lcs.emplace(cell, first, splitter.size(), level+1);
-                std::copy(splitter.begin(), splitter.end(), element_vec.begin() + first); //update the element_vec
-                for (auto x: splitter) {
-                    in_cell[x] = std::prev(cell,1);                                                  //update in_cell
-                }
-                if(splitter.size()>1){                                                            //update non_singleton
-                    non_singleton.insert(cell_it, new_cell_it);
+std::uint64_t cellquads_invariant(const Graph& graph, const Vertex* cell_begin, const Vertex* cell_end, Vertex vertex,
+                                  std::vector<unsigned int>& parity){
+    auto toggle = [&](Vertex member, unsigned int& odd){  //adds member to the set, odd counts vertices with parity 1
+        for(Vertex neighbor: graph.neighbors(member)){
+            odd += parity[neighbor] ? -1 : 1;
+            parity[neighbor] ^= 1;
+        }
+    };
+    std::uint64_t value = 0;
+    unsigned int odd = 0;
+    toggle(vertex, odd);
+    for(const Vertex* w=cell_begin; w!=cell_end; w++){
+        if(*w == vertex){
+            continue;
+        }
+        toggle(*w, odd);
+        for(const Vertex* x=w+1; x!=cell_end; x++){
+            if(*x == vertex){
+                continue;
+            }
+            toggle(*x, odd);
+            for(const Vertex* y=x+1; y!=cell_end; y++){      //the parities of the set with y, without changing them
+                if(*y == vertex){
+                    continue;
                 }
-                first += splitter.size();
-                                                                                                    //update subsequence
-                if (cell_in_subsequence) {                                //replace the cell by the splitters one by one
-                    subsequence.insert(pos_in_subsequence,*new_cell_it);
+                unsigned int adjacent_to_odd = odd;
+                for(Vertex neighbor: graph.neighbors(*y)){
+                    adjacent_to_odd += parity[neighbor] ? -1 : 1;
                 }
-                else if (splitter !=first_largest_splitter) {              //or add all but one of the largest splitters
-                    subsequence.push_back(*new_cell_it);
+                value += mix_hash(adjacent_to_odd);
+            }
+            toggle(*x, odd);
+        }
+        toggle(*w, odd);
+    }
+    toggle(vertex, odd);
+    return value;
+}
+
+
+void Partition::vertex_invariant_values(const Graph& graph, VertexInvariant method, const std::vector<Vertex>& vertices,
+                                        ThreadPool* pool){
+    auto compute = [&](std::size_t begin, std::size_t end){           //every thread writes the values of its vertices
+        std::vector<unsigned int> scratch(get_size(), method == distances ? no_distance : 0);
+        std::vector<Vertex> queue;
+        for(std::size_t i=begin; i<end; i++){
+            Vertex vertex = vertices[i];
+            switch(method){
+                case distances:
+                    invariant_values[vertex] = distance_invariant(graph, in_cell, vertex, scratch, queue);
+                    break;
+                case adjtriang:
+                    invariant_values[vertex] = adjtriang_invariant(graph, in_cell, vertex, scratch);
+                    break;
+                case triples: {
+                    const CellStruct& cell = cells[in_cell[vertex]];
+                    const Vertex* cell_begin = element_vec.data() + cell.first;
+                    invariant_values[vertex] = triples_invariant(graph, cell_begin, cell_begin + cell.length, vertex,
+                                                                 scratch, queue);
+                    break;
                 }
-                                             //store info about process to use as an invariant, the refinement invariant
-                if(level and use_ref_invar) {
-                    ref_invar.push_back(splitter.size());
+                case cellquads: {
+                    const CellStruct& cell = cells[in_cell[vertex]];
+                    const Vertex* cell_begin = element_vec.data() + cell.first;
+                    invariant_values[vertex] = cellquads_invariant(graph, cell_begin, cell_begin + cell.length, vertex,
+                                                                   scratch);
+                    break;
                 }
+                case no_vertex_invar:
+                    invariant_values[vertex] = 0;
+                    break;
+            }
+        }
+    };
+    run_in_parts(pool, vertices.size(), compute);
+}
+
+bool Partition::split_cell_by_values(const CellStruct& cell){
+    std::vector<std::pair<std::uint64_t, Vertex>> by_value;
+    by_value.reserve(cell.length);
+    for(unsigned int i=cell.first; i<cell.first+cell.length; i++){
+        by_value.emplace_back(invariant_values[element_vec[i]], element_vec[i]);
+    }
+    std::sort(by_value.begin(), by_value.end());                  //vertices of equal value stay sorted among themselves
+    fragment_sizes.clear();
+    std::uint64_t event = mix_hash(cell.first);
+    for(unsigned int i=0; i<cell.length; i++){
+        sort_buffer[cell.first+i] = by_value[i].second;
+        if(i == 0 or by_value[i].first != by_value[i-1].first){
+            fragment_sizes.push_back(0);
+            event = mix_hash(event ^ by_value[i].first);
+        }
+        fragment_sizes.back()++;
+    }
+    if(fragment_sizes.size() == 1){
+        return false;
+    }
+    if(level and (use_quotient_invar or use_trace)) {           //the values are part of the node invariants as well
+        for(unsigned int size: fragment_sizes){
+            event = mix_hash(event ^ size);
+        }
+        quotient_invar = mix_hash(quotient_invar ^ event);
+        if(use_trace and not extend_trace(event)){
+            trace_aborted = true;
+            return false;
+        }
+    }
+    split_cell(cell, fragment_sizes.size(), level);
+    return true;
+}
 
+bool Partition::refine_by_vertex_invariant(const Graph& graph, VertexInvariant method, ThreadPool* pool){
+    if(method == no_vertex_invar or is_discrete()){
+        return false;
+    }
+    invariant_values.resize(get_size());
+    std::vector<CellStruct> non_singleton_cells;               //copies, splitting one cell does not change the others
+    for(unsigned int cell=next_non_singleton[get_size()]; cell!=get_size(); cell=next_non_singleton[cell]){
+        non_singleton_cells.push_back(cells[cell]);
+    }
+    bool split = false;
+    if(method == triples or method == cellquads){                  //cell by cell, until the first one that is split
+        for(const CellStruct& cell: non_singleton_cells){
+            if(method == cellquads and (cell.length < 4 or cell.length > max_cellquads_cell_size)){
+                continue;
             }
-                                                  //store some info of the refinement making later backtracking possible
-                                                 //if in_level is already level+1 then cell has been created during this
-                                                                  //refinement and is covered by previous backtrack info
-            if(not refinement_stacks.empty() and (cell->in_level != level+1)) {
-                std::prev(cell, 1)->in_level = cell->in_level;    //last cell is not seen as newly created, old level
-                refinement_stacks.back().push(cell->first);            //cell was the cell being split, keep first value
+            std::vector<Vertex> vertices(element_vec.begin()+cell.first, element_vec.begin()+cell.first+cell.length);
+            vertex_invariant_values(graph, method, vertices, pool);
+            if(split_cell_by_values(cell)){
+                split = true;
+                break;
             }
+            if(trace_aborted){
+                break;
+            }
+        }
+    }
+    else{                                         //all values are computed before any cell is split by them
+        std::vector<Vertex> vertices;
+        for(const CellStruct& cell: non_singleton_cells){
+            vertices.insert(vertices.end(), element_vec.begin()+cell.first, element_vec.begin()+cell.first+cell.length);
+        }
+        vertex_invariant_values(graph, method, vertices, pool);
+        for(const CellStruct& cell: non_singleton_cells){
+            split = split_cell_by_values(cell) or split;
+            if(trace_aborted){
+                break;
+            }
+        }
+    }
+    if(split){
+        refine_splitters(graph, level);                             //refine by the queued fragments, as after a split
+    }
+    return split;
+}
+
 
-            lcs.erase(cell);                                                           //delete cell in lcs of partition
-                                                //erase deletes iterator and returns the one after, so this is like a ++
-            cell_it = non_singleton.erase(cell_it);
-            cell_it = std::prev(cell_it, 1);                                      //reverse the ++ before end of loop
-            if (cell_in_subsequence) {
-                subsequence.erase(pos_in_subsequence);                          //we replace the cell, so remove old one
+
+/*
+ * color_pairs(n, hash_row, colors, pool)
+ *
+ * Calls hash_row(u, row) for every vertex u, which writes a hash of the new color of each pair (u, v) to row[v], and
+ * colors the pairs by the ranks of their hashes among the distinct ones. Each thread hashes its rows into a buffer of
+ * its own, the hashes are numbered in a hash map as they come and the numbers replaced by the ranks at the end, so
+ * the colors only depend on the values of the hashes and are as canonical as those.
+ *
+ * Returns: The number of distinct hashes
+ */
+std::size_t color_pairs(std::size_t n, const std::function<void(std::size_t, std::uint64_t*)>& hash_row,
+                        std::vector<std::uint32_t>& colors, ThreadPool* pool){
+    std::unordered_map<std::uint64_t, std::uint32_t> numbers;
+    std::mutex numbers_mutex;
+    run_in_parts(pool, n, [&](std::size_t begin, std::size_t end){
+        std::vector<std::uint64_t> row(n);
+        for(std::size_t u=begin; u<end; u++){
+            hash_row(u, row.data());
+            std::lock_guard<std::mutex> lock(numbers_mutex);               //held for a row, hashing it took O(n^2)
+            for(std::size_t v=0; v<n; v++){
+                colors[u*n+v] = numbers.emplace(row[v], numbers.size()).first->second;
             }
         }
+    });
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> distinct(numbers.begin(), numbers.end());
+    std::sort(distinct.begin(), distinct.end());
+    std::vector<std::uint32_t> rank(distinct.size());
+    for(std::size_t i=0; i<distinct.size(); i++){
+        rank[distinct[i].second] = i;
     }
-    level++;                                   //refinement is done, partition now for the next (or first) level in tree
+    run_in_parts(pool, n, [&](std::size_t begin, std::size_t end){
+        for(std::size_t i=begin*n; i<end*n; i++){
+            colors[i] = rank[colors[i]];
+        }
+    });
+    return distinct.size();
+}
+
+bool Partition::refine_by_2wl(const Graph& graph, ThreadPool* pool){
+    if(is_discrete()){
+        return false;
+    }
+    std::size_t n = get_size();
+    std::vector<std::uint32_t> colors(n * n);                              //row u holds the colors of the pairs (u, v)
+    std::vector<std::uint32_t> new_colors(n * n);
+    std::size_t num_colors = color_pairs(n, [&](std::size_t u, std::uint64_t* row){  //the cells of both and adjacency
+        for(std::size_t v=0; v<n; v++){
+            row[v] = 2 * (u == v);
+        }
+        for(Vertex neighbor: graph.neighbors(u)){
+            row[neighbor] += 1;
+        }
+        for(std::size_t v=0; v<n; v++){
+            row[v] = mix_hash(mix_hash(std::uint64_t(in_cell[u]) << 32 | in_cell[v]) ^ row[v]);
+        }
+    }, colors, pool);
+    while(true){
+                        //the new color of (u, v) is its old one and the multiset of the colors of (u, w) and (w, v)
+        std::size_t new_num_colors = color_pairs(n, [&](std::size_t u, std::uint64_t* row){
+            const std::uint32_t* colors_u = colors.data() + u*n;
+            for(std::size_t v=0; v<n; v++){
+                row[v] = mix_hash(~std::uint64_t(colors_u[v]));
+            }
+            for(std::size_t w=0; w<n; w++){                 //row by row over w, so all accesses are sequential
+                std::uint64_t color_uw = std::uint64_t(colors_u[w]) << 32;
+                const std::uint32_t* colors_w = colors.data() + w*n;
+                for(std::size_t v=0; v<n; v++){
+                    row[v] += mix_hash(color_uw | colors_w[v]);
+                }
+            }
+        }, new_colors, pool);
+        colors.swap(new_colors);
+        if(new_num_colors == num_colors){                    //the new colors refine the old ones, so nothing changed
+            break;
+        }
+        num_colors = new_num_colors;
+    }
+
+    invariant_values.resize(n);
+    for(std::size_t v=0; v<n; v++){
+        invariant_values[v] = colors[v*n+v];                                  //a vertex gets the color of (v, v)
+    }
+    std::vector<CellStruct> non_singleton_cells;
+    for(unsigned int cell=next_non_singleton[n]; cell!=n; cell=next_non_singleton[cell]){
+        non_singleton_cells.push_back(cells[cell]);
+    }
+    bool split = false;
+    for(const CellStruct& cell: non_singleton_cells){
+        split = split_cell_by_values(cell) or split;
+        if(trace_aborted){
+            break;
+        }
+    }
+    if(split){
+        refine_splitters(graph, level);
+    }
+    return split;
+}
+
+void Partition::reset_splitter_buffers(const Graph& graph, const CellStruct& cell_w){
+    for(unsigned int i=cell_w.first; i<cell_w.first+cell_w.length; i++){
+        for(Vertex neighbor: graph.neighbors(element_vec[i])){
+            degree_count[neighbor] = 0;
+        }
+    }
+    for(unsigned int touched_cell: touched_cells){
+        touched_in_cell[touched_cell] = 0;
+    }
+    touched_cells.clear();
+}
+
+bool Partition::extend_trace(std::uint64_t event){
+    if(trace_comparison == 0 and compare_trace != nullptr){   //only the first differing event decides the comparison
+        std::size_t position = trace.size();
+        if(position >= compare_trace->size() or event > (*compare_trace)[position]){  //longer with equal prefix too
+            trace_comparison = 1;
+        }
+        else if(event < (*compare_trace)[position]){
+            trace_comparison = -1;
+        }
+    }
+    trace.push_back(event);
+    return trace_comparison >= 0;
 }
 
 void Partition::split_by_and_refine(const Graph &graph, int vertex) {          //split the partition by the given vertex
 
-    CellStruct& cell = *in_cell[vertex];                                                        //shorten name for usage
+    CellStruct& cell = cells[in_cell[vertex]];                                                  //shorten name for usage
     if(cell.length == 1) {                                                               //trivial cell, cannot be split
         throw std::runtime_error("Cannot split partition by vertex in trivial cell.");
     }
-                                                                       //partition the elements of Cell into v and not v
-    std::stable_partition(element_vec.begin()+cell.first,
-                          element_vec.begin()+cell.first+cell.length, [vertex](int a){return a==vertex;});
+    trail_level_start.push_back(trail.size());           //new level, the splits from now on are undone to return here
+    record_split(cell);                                                              //first info: we split this cell
+                                      //partition the elements of Cell into v and not v, keeping the order of the others
+    std::vector<Vertex>::iterator vertex_pos = std::find(element_vec.begin()+cell.first,
+                                                         element_vec.begin()+cell.first+cell.length, vertex);
+    std::rotate(element_vec.begin()+cell.first, vertex_pos, vertex_pos+1);
                                                                        //create new CellStruct for old cell minus vertex
-                                                                     //and emplace that into list after now trivial cell
-    auto it_new_cell = lcs.emplace(std::next(in_cell[vertex], 1),
-            cell.first+1, cell.length-1, cell.in_level);
+                                                                           //and place that after the now trivial cell
+    CellStruct& new_cell = cells[cell.first+1] = CellStruct(cell.first+1, cell.length-1, cell.in_level);
+    num_cells++;
     cell.length = 1;                                                               //change first CellStruct accordingly
-    for (auto it = element_vec.begin()+it_new_cell->first;
-              it!=element_vec.begin()+it_new_cell->first+it_new_cell->length; it++) {
-        in_cell[*it] = it_new_cell;                                                                     //update in_cell
+    for (auto it = element_vec.begin()+new_cell.first;
+              it!=element_vec.begin()+new_cell.first+new_cell.length; it++) {
+        in_cell[*it] = new_cell.first;                                                                  //update in_cell
     }
-                                                                                 //get iterator in list of non-singleton
-    std::list<std::list<CellStruct>::iterator>::iterator cell_it =
-            std::find(non_singleton.begin(), non_singleton.end(), in_cell[vertex]);
-    if(it_new_cell->length>1){
-        non_singleton.insert(cell_it, it_new_cell);                       //insert iterator to new cell of non-singleton
+    unsigned int last_non_singleton = prev_non_singleton[cell.first];
+    unlink_non_singleton(cell.first);                //remove old cell from non-singleton since it only contains 'vertex'
+    if(new_cell.length>1){
+        link_non_singleton(new_cell.first, last_non_singleton);    //and insert new cell into non-singleton in its place
     }
-    non_singleton.erase(cell_it);                    //remove iterator to old cell since that only contains 'vertex' now
     cell.in_level = level+1;                         //the single vertex cell is considered as created at the next level
-    refinement_stacks.emplace_back();          //new level, empty stack to store info about refinement on the next level
-    refinement_stacks.back().push(cell.first);                                     //first info: we split at cell->first
 
                                              //Store info about process to use as an invariant, the refinement invariant
     if(use_ref_invar) {
         ref_invar.clear();
-        ref_invar.push_back(it_new_cell->length + 1);
+        ref_invar.push_back(new_cell.length + 1);
     }
-    refinement(graph, std::list<CellStruct>{cell});                                            //then, refine
+    if(use_quotient_invar) {
+        quotient_invar = mix_hash(std::uint64_t(cell.first) << 32 | (new_cell.length + 1));
+    }
+    queue_splitter(cell.first);
+    if(use_trace) {
+        trace.clear();
+        trace_comparison = 0;
+        trace_aborted = false;
+        trace_aborted = not extend_trace(mix_hash(std::uint64_t(cell.first) << 32 | (new_cell.length + 1)));
+    }
+    refinement(graph);                                                                                 //then, refine
 }
 
 
-void Partition::merge_cells(std::list<CellStruct>::iterator first_cell, std::list<CellStruct>::iterator last_cell){
-                                              //want all the cells in the range to be merged into first_cell, set length
-    first_cell->length = (last_cell->first - first_cell->first) + last_cell->length;
-    first_cell->in_level = last_cell->in_level;       //function is for backtracking, here to the level of the last cell
-                                                     //merged CellStruct's into one, now reorder elements of merged cell
-    std::sort(element_vec.begin()+first_cell->first, element_vec.begin()+first_cell->first+first_cell->length);
-    for(auto it= element_vec.begin()+first_cell->first;
-             it!= element_vec.begin()+first_cell->first+first_cell->length; it++){
-        in_cell[*it] = first_cell;                                               //update in which cell the elements lie
-    }
-
-                                                 //first update non_singleton before lcs to not invalidate the iterators
-    if(non_singleton.empty()){
-        non_singleton.push_back(first_cell);                                         //it is the only non_singleton cell
-    }
-    else{
-                                                          //find the position in the ordered list of non_singleton cells
-                                                //for that, find first existing non_singleton having a later first_field
-        std::list<std::list<CellStruct>::iterator>::iterator first_larger =
-                std::find_if(non_singleton.begin(),non_singleton.end(),
-                [first_cell](std::list<CellStruct>::iterator cell){return cell->first >= first_cell->first;});
-                                                                                                 //insert it before that
-        non_singleton.insert(first_larger, first_cell);//also works when first_larger == end(), then it's like push_back
+void Partition::record_split(const CellStruct& cell){
+    trail.push_back(SplitRecord{cell, prev_non_singleton[cell.first]});
+    trail_elements.insert(trail_elements.end(), element_vec.begin()+cell.first,
+                          element_vec.begin()+cell.first+cell.length);               //the elements in the old order
+}
 
-        while(first_larger!=non_singleton.end() and (*first_larger)->first <= first_cell->first+first_cell->length-1){
-            first_larger = non_singleton.erase(first_larger);              //and erase all non_singletons that it covers
+void Partition::undo_split(){
+    const SplitRecord record = trail.back();
+    const CellStruct& old_cell = record.cell;
+    trail.pop_back();
+                                             //the fragments of the split are exactly the cells in range of the old cell
+    for(unsigned int first=old_cell.first; first<old_cell.first+old_cell.length; first+=cells[first].length){
+        if(cells[first].length > 1){
+            unlink_non_singleton(first);
         }
+        num_cells--;
     }
-                                                                 //remove all but the first cell, including the last one
-    lcs.erase(std::next(first_cell, 1), std::next(last_cell,1));
+    num_cells++;
+    cells[old_cell.first] = old_cell;                                   //the first fragment was at the index of the cell
+    std::copy(trail_elements.end()-old_cell.length, trail_elements.end(), element_vec.begin()+old_cell.first);
+    trail_elements.resize(trail_elements.size()-old_cell.length);
+    for(unsigned int i=old_cell.first; i<old_cell.first+old_cell.length; i++){
+        in_cell[element_vec[i]] = old_cell.first;                               //update in which cell the elements lie
+    }
+                                                 //all later splits are undone, so its neighbor in the list is there again
+    link_non_singleton(old_cell.first, record.prev_non_singleton);
 }
 
 void Partition::reconstruct_at_level(unsigned int return_level) {
     if(return_level<1){
         throw std::runtime_error("Cannot return to level before root.");
     }
-                                                    //get the stack containing the info to backtrack to the wanted level
-    std::stack<unsigned int>& bt_stack= refinement_stacks[return_level-1];
-    while(not bt_stack.empty()){                                            //for each split merge again the split cells
-                                                 //these are all the cells after first with a higher in_level value than
-                                                    //the return_level plus the first with in_level at most return_level
-        int first = bt_stack.top();
-        int element_at_first = element_vec[first];
-        bt_stack.pop();
-        if(in_cell[element_at_first]->in_level > return_level) {
-                                                                                   //find last cell up to which we merge
-            auto last_cell = std::find_if(in_cell[element_at_first], lcs.end(),
-                    [return_level](const CellStruct& cell) { return (cell.in_level <= return_level); });
-            merge_cells(in_cell[element_at_first], last_cell);
-        }
+                                          //undo all splits since the partition was split at the wanted level, in reverse
+    while(trail.size() > trail_level_start[return_level-1]){
+        undo_split();
     }
     level = return_level;                                              //partition is now the one it was at return_level
-    refinement_stacks.resize(return_level-1);                          //later stack info is not needed anymore
+    trail_level_start.resize(return_level-1);                             //later trail info is not needed anymore
     if(use_ref_invar) {
                                                             //resetting it to be empty here is ok since a new refinement
         ref_invar.clear();                               //is made in Nautyyy before the node invariant is applied again
     }
+    quotient_invar = 0;
 }
-//! doc of actual backtrack procedure and in_level assignment
 /*
- * When a cell is split anywhere, all but the last cell assume the level of the partition the split happened in, the
- * last cell keeps its in_level value and that signifies the earliest level this and the previous cells belonged together.
- * Example [0,1,2,3] is equitable and split by 1 refines to [1|0|2,3] and split by 2 refines to [1|0|2|3]
- * in_level:1,1,1,1                                          2,2,1,1                             2,1,3,1
- *   all in same level.                 cell 1, 0 newly created, in_level 2             cell 2 newly created
- *                                       but 2,3 as last cell in_level 1                thus in_level is 3
- *  splits stored:                       split by 1, then by 0 in refinement            split by 2
- *  (as 'first')
- *
- *  Now to go back up to level k, we consult stack at level k and merge from the cell that has that firs field till the
- *  first succeeding cell with in_level value at most k.
- *  Example above: Recover partition at level 2. from stack we get first field 2, next cell has in_level 1 which is
- *  at most 2, so cell at index 2 and 3 are merged. Recover partition at level 1. from stack we get 1 (as the first
- *  field of cell 0. Next cell is 2 with in_level 2, greater than 1, go on to cell 3 with in_level value of 1 so
- *  merge cells 0,2,3 to get [1|0,2,3] and now from stack we get the first value 0, continue.
+ * Example of backtracking with the trail: [0,1,2,3] is equitable and split by 1 refines to [1|0|2,3] and split by 2
+ * refines to [1|0|2|3]. The trail then holds
+ *   level 1: [0,1,2,3] split into [1|0,2,3], [0,2,3] split into [0|2,3]           level 2: [2,3] split into [2|3]
+ * To recover the partition at level 2, the records after the start of level 2 are undone, merging [2|3] again. To
+ * recover the one at level 1, also the two records of level 1 are undone in reverse, giving [1|0,2,3] and [0,1,2,3].
  */
 
 
-CellStruct Partition::target_cell_selector(const Graph& graph, TargetcellMethod method) const {
+CellStruct Partition::target_cell_selector(const Graph& graph, TargetcellMethod method) {
                                                          //there are three methods of choosing a non-trivial cell so far
                                                                //"first smallest", "first", and "most non-trivial joins"
-    if(non_singleton.empty()){
+    if(is_discrete()){
         throw std::runtime_error("All cells are trivial, no target cell can be selected.");
     }
-    if(method == first or (non_singleton.size() == 1)){                  //chose and return the first non-singleton cell
-        return *non_singleton.front();
+    if(method == first or (num_non_singleton == 1)){                     //chose and return the first non-singleton cell
+        return cells[next_non_singleton[get_size()]];
     }
     else if(method == first_smallest) {                                   //find first non trivial cell of smallest size
         unsigned int min = std::numeric_limits<int>::max();                                                   //infinity
-        std::list<CellStruct>::const_iterator index = lcs.end();
+        unsigned int index = get_size();
         unsigned int size;
-        for (auto it: non_singleton) {
-            size = it->length;
+        for(unsigned int it=next_non_singleton[get_size()]; it!=get_size(); it=next_non_singleton[it]){
+            size = cells[it].length;
             if(size == 2){                      //consideration: can immediately stop if a cell of size 2 has been found
-                return *it;
+                return cells[it];
             }
             else if (size < min) {
                 min = size;
                 index = it;
             }
         }
-        if (index != lcs.end()) {
-            return *index;
+        if (index != get_size()) {
+            return cells[index];
         }
     }
     else if(method == joins){
@@ -453,70 +862,42 @@ CellStruct Partition::target_cell_selector(const Graph& graph, TargetcellMethod
 }
 
 
-CellStruct Partition::most_non_trivial_joins(const Graph& graph) const {
+CellStruct Partition::most_non_trivial_joins(const Graph& graph) {
                                    //returns the number of cells to which the cell of vertex is non_trivially joined to.
                       //Assuming the given partition to be equitable, we only need to check a single vertex of the class
-    if(non_singleton.empty()){
+    if(is_discrete()){
         throw std::runtime_error("All cells are trivial, no target cell can be selected.");
     }
-    std::vector<int> count = std::vector<int>(non_singleton.size(), 0);          //count the non-trivial joins
-    std::vector<int> decode_cell_2 = std::vector<int>();
-    std::list<std::list<CellStruct>::iterator>::const_iterator it_cell_1 = non_singleton.begin();
-    std::list<std::list<CellStruct>::iterator>::const_iterator it_cell_2;
-    unsigned int current_degree = 0;
-    for (size_t cell_1=0, end = non_singleton.size(); cell_1<end; cell_1++) {            //check for each pair if non-trivially joined
-        it_cell_2 = std::next(it_cell_1,1);                     //excludes checking if non-trivially joined to itself
-        for (size_t cell_2=cell_1+1; cell_2<end; cell_2++) {
-
-            decode_cell_2 = std::vector<int>(element_vec.begin()+(*it_cell_2)->first,
-                                             element_vec.begin()+(*it_cell_2)->first+(*it_cell_2)->length);
-
-            current_degree = graph.degree(element_vec[(*it_cell_1)->first], decode_cell_2);
-            if ((0 < current_degree)
-                and (current_degree < (*it_cell_2)->length)) {
-                count[cell_1]++;
-                count[cell_2]++;
+    unsigned int max_cell = get_size();
+    unsigned int max_count = 0;
+    for(unsigned int cell=next_non_singleton[get_size()]; cell!=get_size(); cell=next_non_singleton[cell]){
+        for(Vtype neighbor: graph.neighbors(element_vec[cell])){     //the row of the cell in the quotient matrix,
+            unsigned int other_cell = in_cell[neighbor];               //only for the other non-singleton cells
+            if(other_cell != cell and cells[other_cell].length > 1 and degree_count[other_cell]++ == 0){
+                touched_cells.push_back(other_cell);
             }
-            it_cell_2++;                     //manually increment the iterators since for loop is to get index for count
         }
-        it_cell_1++;
-    }
-                                                           //return the first element that achieves the maximum in count
+        unsigned int count = 0;                                                        //count the non-trivial joins
+        for(unsigned int other_cell: touched_cells){
+            count += (degree_count[other_cell] < cells[other_cell].length);
+            degree_count[other_cell] = 0;
+        }
+        touched_cells.clear();
+                                                           //keep the first cell that achieves the maximum in count
                                         //also works if there are no non-trivial joins, returns first non-singleton cell
-    int max_pos = std::distance(count.begin(), std::max_element(count.begin(), count.end()));
-    std::list<std::list<CellStruct>::iterator>::const_iterator max_cell = std::next(non_singleton.begin(), max_pos);
-    return **max_cell;                                                                 //double iterator needs double **
+        if(max_cell == get_size() or count > max_count){
+            max_cell = cell;
+            max_count = count;
+        }
+    }
+    return cells[max_cell];
 }
 
 
 InvarType Partition::shape_invar() {
     InvarType result{};
-    for(auto cell: lcs){
-        result.push_back(cell.length);                              //simply encodes the sizes of cells of the partition
+    for(unsigned int first=0; first<get_size(); first+=cells[first].length){
+        result.push_back(cells[first].length);                      //simply encodes the sizes of cells of the partition
     }
     return result;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
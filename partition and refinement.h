@@ -7,21 +7,21 @@
  * (i) n-element integer vector element_vec. The elements in each cell are stored in consecutive
  * entries of element array so that the cells themselves form contiguous subarrays.
  *
- * (ii) An ordered, doubly linked list of cell structures describing the cells. Each cell structure has 1. the
- * integer ﬁelds 'first' and 'length' defining the subarray element_vec[first, first+1, ..., first+length-1] and
- * 2. a field 'in_level' detailing at which level the cell was created.
+ * (ii) An n-element array of cell structures describing the cells, indexed by the position of the first element of
+ * each cell. Each cell structure has 1. the integer ﬁelds 'first' and 'length' defining the subarray
+ * element_vec[first, first+1, ..., first+length-1] and 2. a field 'in_level' detailing at which level the cell was
+ * created. Only the entries at the first position of a cell are valid, the cells are ordered by these positions and
+ * the cell following the one at first is the one at first+length.
  *
- * (iii) An n-element array of iterators to the cell structures in the list. For a vertex x, the element in cell[x] is
- * the iterator of the position of the cell structure in the list, the corresponding cell contains x.
+ * (iii) An n-element array of cell indices. For a vertex x, the element in in_cell[x] is the first position of the cell
+ * containing x.
  *
- * Additionally there is an ordered doubly linked list keeping track of all the non_singleton cells of the partition and
- * there is the field 'level' and a vector of refinement stacks storing information of the refinement
- * procedure to reconstruct the partition at a given level.
+ * Additionally there is an ordered, intrusive doubly linked list keeping track of all the non_singleton cells of the
+ * partition, stored as two arrays of cell indices, and there is the field 'level' and a trail, an undo log of all
+ * the splits of cells made since the root, to reconstruct the partition at a given level in reverse order.
+ * None of these structures allocates memory when cells are split or merged, apart from the trail growing.
  *
  *
- * I willingly renounced the use of the auto identifier for the most part in this file and the .cpp because for me it
- * is more important to be very clear about which kind of iterator I am using to avoid confusion.
- *
  * The main reference for the implementation of this data structure is:
  * Junttila, Tommi A. and Petteri Kaski.
  * “Engineering an Efficient Canonical Labeling Tool for Large and Sparse Graphs.”
@@ -34,13 +34,13 @@
 #include <vector>
 #include <numeric>
 #include <iostream>
-#include <list>
-#include <stack>
-#include <map>
 #include <algorithm>
 #include <stdexcept>
+#include <limits>
+#include <functional>
 
 #include "sparse_graph.h"
+#include "thread_pool.h"
 
 
 /*
@@ -70,6 +70,18 @@ struct CellStruct{
     bool operator==(const CellStruct& rhs) const;
 };
 
+/*
+ * SplitRecord
+ * Purpose: An entry of the trail of a Partition, the data of a cell right before it was split
+ * cell: the cell as it was, the fragments it was split into are exactly the cells in its range
+ * prev_non_singleton: the non singleton cell before it in the list of non singleton cells
+ * The elements of the cell in their order before the split are kept separately on the trail as well
+ */
+struct SplitRecord{
+    CellStruct cell;
+    unsigned int prev_non_singleton;
+};
+
 
 /*
  * Partition
@@ -77,19 +89,33 @@ struct CellStruct{
  *
  * Member variables:
  * element_vec: contains all the vertices of the graph in the order corresponding to the cells of the Partition
- * lcs: a list of CellStruct's to keep track of the cell of the partition
- * in_cell: for each vertex v in_cell[v] is an iterator of the list containing the cell structures
- * non_singleton: a ordered list of iterators to lcs with only the non singleton cells
+ * cells: the CellStruct's of the partition, cells[first] is the cell starting at element_vec[first]
+ * in_cell: for each vertex v in_cell[v] is the index in cells (i.e. the first field) of the cell containing v
+ * next_non_singleton, prev_non_singleton: the ordered list of only the non singleton cells, linked via their indices.
+ *                                         The index get_size() is the head of the list, so an empty list points to it
+ * num_cells, num_non_singleton: the number of cells and of non singleton cells
+ * next_splitter, last_splitter, in_splitter_queue: the splitter queue of the refinement as a singly linked list of
+ *      cell indices with head get_size(), its last cell and for each cell index whether the cell is queued
+ * degree_count, touched_in_cell, touched_cells, degree_start, fragment_sizes, fragment_degrees, sort_buffer:
+ *      reusable buffers of the
+ *      refinement, so it does not allocate. degree_count[v] is the degree of v into the current splitter cell and
+ *      touched_in_cell[c] the number of vertices of cell c with a positive degree, both are zero between splitters
+ * invariant_values: for each vertex its value under the last vertex invariant used, see refine_by_vertex_invariant,
+ *                   or its color after refine_by_2wl
  * level: level of the partition as in the level of the node in the search tree this partition belongs to
- * refinement_stacks: keeps for each partition on a previous level the necessary info in a stack to return to that level
- *                    this info is roughly the first field of each cell that was newly created
+ * trail: a SplitRecord for every cell split since the root, in the order of the splits
+ * trail_elements: the elements of these cells in their order before the split, concatenated in the same order
+ * trail_level_start: for each level of the search tree the size of the trail when the partition was split at it,
+ *                    undoing the trail back to it gives the partition at that level again
+ * trace_comparison: while use_trace is set, how the trace compares to compare_trace so far. 0 if they are equal up to
+ *                   now, positive if trace is already greater and negative if it fell below and refinement stopped
  * 
  * Simple member functions:
  * Partition(): constructs an empty partition with zero elements
  * Partition(n): initializes the unit partition on n vertices
  * Partition(other_format_partition): Transforms a partition of the format vector of vectors of ints to a class Object
- * Partition(old): Copies and constructs a given Partition
- * operator=(rhs): Implements an assignment operator
+ * Partition(old): Copies and constructs a given Partition, no pointers are involved so a member-wise copy suffices
+ * operator=(rhs): Implements an assignment operator, reusing the memory of the assigned to partition
  * Print(): Simply outputs the partition in the format [[cell1][cell2]...[cellk]]
  * print_detail(): Next to what print does, this outputs to each vertex the first field of the cell it belongs to +more
  * print_non_singleton(): Only outputs the cells with more than 1 element, same format as print
@@ -103,17 +129,58 @@ struct CellStruct{
 struct Partition{
 private:
     std::vector<Vertex> element_vec;
-    std::list<CellStruct> lcs;
-    std::vector<std::list<CellStruct>::iterator> in_cell;
-    std::list<std::list<CellStruct>::iterator> non_singleton;
+    std::vector<CellStruct> cells;
+    std::vector<unsigned int> in_cell;
+    std::vector<unsigned int> next_non_singleton;
+    std::vector<unsigned int> prev_non_singleton;
+    unsigned int num_cells;
+    unsigned int num_non_singleton;
+    std::vector<unsigned int> degree_count;
+    std::vector<unsigned int> touched_in_cell;
+    std::vector<unsigned int> touched_cells;
+    std::vector<unsigned int> degree_start;
+    std::vector<unsigned int> fragment_sizes;
+    std::vector<unsigned int> fragment_degrees;
+    std::vector<Vertex> sort_buffer;
+    std::vector<std::uint64_t> invariant_values;
+    std::vector<unsigned int> next_splitter;
+    unsigned int last_splitter;
+    std::vector<bool> in_splitter_queue;
     unsigned int level;
-    std::vector<std::stack<unsigned int>> refinement_stacks;
+    std::vector<SplitRecord> trail;
+    std::vector<Vertex> trail_elements;
+    std::vector<unsigned int> trail_level_start;
+    int trace_comparison = 0;
+
+    /*
+     * link_non_singleton(cell, after) inserts the cell at index cell into the list of non singleton cells after the
+     *                                 cell at index after, which may be the head get_size()
+     * unlink_non_singleton(cell) removes the cell from that list
+     */
+    void link_non_singleton(unsigned int cell, unsigned int after);
+    void unlink_non_singleton(unsigned int cell);
+    /*
+     * queue_splitter(cell, after) inserts the cell into the splitter queue after the queued cell after, which may be
+     *                             the head get_size(). queue_splitter(cell) appends it at the end of the queue
+     * pop_splitter() removes the first cell from the splitter queue and returns it
+     */
+    void queue_splitter(unsigned int cell, unsigned int after);
+    void queue_splitter(unsigned int cell);
+    unsigned int pop_splitter();
+    /*
+     * extend_trace(event) appends the event to trace and compares it with the entry of compare_trace at the same
+     *                     position, unless the result of the comparison is already known.
+     *                     Returns false if trace is now lexicographically smaller than compare_trace
+     * reset_splitter_buffers(graph, cell_w) zeroes degree_count and touched_in_cell after splitting by the cell cell_w
+     */
+    bool extend_trace(std::uint64_t event);
+    void reset_splitter_buffers(const Graph& graph, const CellStruct& cell_w);
 public:
     explicit Partition();
     explicit Partition(unsigned int n);
     explicit Partition(const std::vector<std::vector<Vertex>> &other_format_partition);
-    Partition(const Partition& old);
-    Partition& operator=(const Partition& rhs);
+    Partition(const Partition& old) = default;
+    Partition& operator=(const Partition& rhs) = default;
     void print() const;
     void print_detail() const;
     void print_non_singleton() const;
@@ -131,39 +198,44 @@ public:
 
 private:
     /*
-     * decomposition(graph, cell_v, cell_w) Decomposes elements of cell_v according to their degree to cell_w.
-     *                                      Is used as a helper function for refinement.
+     * sort_cell_by_degrees(cell) Decomposes the elements of cell according to their degree in degree_count, which holds
+     *                            the degrees into the current splitter cell. Is used as a helper function for refinement.
      *
-     * Parameter: graph A graph in which the vertices lie and is needed to decompose according to degree
-     *            cell_v, cell_w Both vectors of int's representing vertices of the graph
-     * Returns: A vector of subsets of cell_v in ascending order in regards to their elements degree to cell_w
+     * Parameter: cell A cell of the partition
+     * Action: The elements of cell are stably sorted ascendingly by degree with a counting sort into sort_buffer, at
+     *         the same positions as in element_vec. The sizes of the groups of equal degree are stored in
+     *         fragment_sizes and their degrees in fragment_degrees, in the same order
+     * Returns: The number of such groups. If it is 1, the cell cannot be split and sort_buffer was not touched
      */
-    static std::vector<std::vector<int>> decomposition(const Graph& graph, const std::vector<int>& cell_v, const std::vector<int>& cell_w);
+    unsigned int sort_cell_by_degrees(const CellStruct& cell);
     /*
-     * sp_decomposition(graph, cell_v, cell_w) A slight variant of decomposition which employs the pre computed degrees
-     *
-     * Parameter: graph as above
-     *            cell which we want to decompose according to
-     *            all_degrees the vector containing the degrees of all vertices into a cell chosen before
-     * Returns: A vector of subsets of cell_v in ascending order in regards to their elements degree in all_degrees
+     * split_cell(cell, num_fragments, new_level) Replaces cell by num_fragments new cells of level new_level, whose
+     *                                            elements are in sort_buffer and sizes in fragment_sizes, as left by
+     *                                            sort_cell_by_degrees. The split is recorded on the trail and the
+     *                                            fragments are queued as splitters as in (2013) McKay
+     * refine_splitters(graph, new_level) The main loop of refinement, refines the partition by the cells in the
+     *                                    splitter queue until it is empty, new cells are created at new_level
      */
-    static std::vector<std::vector<unsigned int>>
-    sp_decomposition(const std::vector<unsigned int> &cell, std::map<unsigned int, unsigned int> &all_degrees);
+    void split_cell(const CellStruct& cell, unsigned int num_fragments, unsigned int new_level);
+    void refine_splitters(const Graph& graph, unsigned int new_level);
 
 public:
     /*
-     * refinement(graph, pi, subsequence) Performs the refinement procedure as given in (2013) McKay on the
-     *                                     partition it is called on. Stores information used for backtracking
-     *                                     to previous partitions.
+     * refinement(graph) Performs the refinement procedure as given in (2013) McKay on the partition it is called on.
+     *                   Stores information used for backtracking to previous partitions.
      *
      * Parameter: graph The procedure refines the partition according to this given graph
-     *            subsequence A list of some cells of pi, used for the refinement. In most cases, that will either be
-     *              all cells of pi or a single trivial one after splitting by a vertex. In these cases, the returned
-     *              partition will be a coarsest equitable refinement of pi.
      *
-     * Action: The partition is now the coarsest equitable refinement of the old partition
+     * The cells used for the refinement are the ones in the splitter queue, the subsequence of (2013) McKay. If it is
+     * empty, all cells of the partition are queued first. In most cases, that will either be all cells or a single
+     * trivial one after splitting by a vertex. In these cases, the returned partition will be a coarsest equitable
+     * refinement of pi.
+     *
+     * Action: The partition is now the coarsest equitable refinement of the old partition and the queue is empty.
+     *         If the refinement was stopped because trace fell below compare_trace, trace_aborted is set instead and
+     *         the partition is left in between, it can only be backtracked with reconstruct_at_level
      */
-    void refinement(const Graph& graph, std::list<CellStruct> subsequence = std::list<CellStruct>());
+    void refinement(const Graph& graph);
 
 
     /*
@@ -181,16 +253,73 @@ public:
 
 private:
     /*
-     * merge_cell(first_first, last_first) Merges the cells from the cell of first_first to the cell of last_first.
-     *                                     Used as a subroutine of reconstruct_at_level
+     * record_split(cell) Puts the given cell on the trail, has to be called right before it is split. Cells are not
+     *                    recorded before the first split by a vertex, the root is never backtracked beyond.
+     * undo_split() Takes the last record off the trail and merges the fragments of that split into the old cell
+     *              again, with its elements in the old order. Used as a subroutine of reconstruct_at_level
+     *
+     * Both take time linear in the size of the cell, undoing the splits in reverse order gives exactly the states of
+     * the partition before each of them
+     */
+    void record_split(const CellStruct& cell);
+    void undo_split();
+
+public:
+    /*
+     * refine_by_vertex_invariant(graph, method, pool) Splits cells of the partition by a vertex invariant and refines
+     *                                                 the result again, for graphs on which refinement alone is too
+     *                                                 weak, e.g. strongly regular ones. Similar to the invariants of
+     *                                                 nauty, (2013) McKay
+     *
+     * Parameter: graph The graph the partition belongs to
+     *            method The vertex invariant, a value for each vertex depending only on the graph and the positions of
+     *                   the cells, so it is preserved by isomorphisms respecting the partition:
+     *            distances: for every other vertex, its distance to the vertex and the cell it is in
+     *            adjtriang: for every neighbor, its cell and the number of common neighbors, i.e. triangles
+     *            triples: for every pair w, x from the cell of the vertex, the number of vertices adjacent to all
+     *                     three. Only computed for the first non singleton cell it splits, as it is costly
+     *            cellquads: for every three w, x, y from the cell of the vertex, the number of vertices adjacent to an
+     *                       odd number of the four. Like triples only for the first cell it splits, and only for cells
+     *                       of 4 up to 64 vertices, as it takes O(k^3) quadruples per vertex of a cell of size k
+     *            pool The threads of the search to compute the values on, nullptr computes them on the calling thread
      *
-     * Parameter: first_cell The first cell in which we want all the cells till last_cell to be merged
-     *            last_cell  The last cell going into the merged cell
+     * The values of the vertices are computed in parallel. Each cell is then split into groups of equal value, ordered
+     * ascendingly by it, and these are refined as after a split by a vertex. The partition keeps its level.
      *
-     * Action: Makes a single cell again out of all the cells in the given range
+     * Returns: Whether the invariant split any cell
      */
-    void merge_cells(std::list<CellStruct>::iterator first_cell, std::list<CellStruct>::iterator last_cell);
-    //since working on the same object it is ok to pass iterators and they will stay valid
+    enum VertexInvariant {no_vertex_invar, distances, adjtriang, triples, cellquads};
+    bool refine_by_vertex_invariant(const Graph& graph, VertexInvariant method, ThreadPool* pool = nullptr);
+
+    /*
+     * refine_by_2wl(graph, pool) Splits the cells of the partition by 2-dimensional Weisfeiler-Leman refinement and
+     *                            refines the result again. Stronger than refinement and the vertex invariants, e.g. on
+     *                            CFI graphs.
+     *
+     * Parameter: graph The graph the partition belongs to
+     *            pool The threads of the search to refine the rows on, nullptr refines them on the calling thread
+     *
+     * Colors the n^2 pairs of vertices, initially by the cells of both vertices, their adjacency and equality. Then the
+     * color of each pair (u, v) is refined by the multiset of the colors of (u, w) and (w, v) over all vertices w until
+     * the number of colors stays the same. The colors are 32 bit ranks, kept in two n*n arrays for the old and the new
+     * ones, so 8 bytes per pair plus a hash map of the distinct colors. The rows are refined in parallel. A vertex v
+     * is then given the color of (v, v) and the partition is split as by a vertex invariant.
+     * Takes O(n^3) time per round, so it is meant for the root or the first few levels of the search tree.
+     *
+     * Returns: Whether any cell was split
+     */
+    bool refine_by_2wl(const Graph& graph, ThreadPool* pool = nullptr);
+
+private:
+    /*
+     * vertex_invariant_values(graph, method, vertices, pool) Computes the value of method for each vertex in vertices
+     *                                                        into invariant_values, spread over the threads of pool if
+     *                                                        worthwhile
+     * split_cell_by_values(cell) Splits the cell by invariant_values as refine_by_vertex_invariant describes
+     */
+    void vertex_invariant_values(const Graph& graph, VertexInvariant method, const std::vector<Vertex>& vertices,
+                                 ThreadPool* pool);
+    bool split_cell_by_values(const CellStruct& cell);
 
 public:
     /*
@@ -215,7 +344,7 @@ public:
      * Returns: A non-trivial cell chooses according to the given method
      */
     enum TargetcellMethod {first, first_smallest, joins};
-    CellStruct target_cell_selector(const Graph& graph, TargetcellMethod method = first_smallest) const;
+    CellStruct target_cell_selector(const Graph& graph, TargetcellMethod method = first_smallest);
 
 private:
     /*
@@ -226,9 +355,14 @@ private:
      *              cell since otherwise it will throw an error
      *
      *
+     * Since the partition is equitable, the degrees of any vertex of a cell into the other cells are the row of that
+     * cell in the quotient matrix, and being non-trivially joined is symmetric. So the row of each non-singleton cell
+     * is counted from the neighbors of its first vertex, in degree_count indexed by cell and without allocating,
+     * which takes O(m) time altogether.
+     *
      * Returns: The first non-trivial cell which is non-trivially joined to the most other cells
      */
-    CellStruct most_non_trivial_joins(const Graph& graph) const;
+    CellStruct most_non_trivial_joins(const Graph& graph);
 
 public:
     /*
@@ -248,6 +382,36 @@ public:
     bool use_ref_invar = false;
     InvarType ref_invar = InvarType();
 
+    /*
+     * use_quotient_invar
+     * quotient_invar
+     *
+     * If use_quotient_invar is true, every split of the refinement process is folded into the 64 bit hash
+     * quotient_invar: for each cell with neighbors in the splitter cell, the positions of both cells and the degree
+     * and size of each of its fragments. These are entries of the quotient graph of the partition, so this is a
+     * stronger invariant than ref_invar, yet compared in constant time.
+     */
+    bool use_quotient_invar = false;
+    std::uint64_t quotient_invar = 0;
+
+    /*
+     * use_trace
+     * trace
+     * compare_trace
+     * trace_aborted
+     *
+     * If use_trace is true, split_by_and_refine records a trace of the refinement that follows: one 64 bit event per
+     * cell with neighbors in the splitter cell, hashing the same data that is folded into quotient_invar, preceded by
+     * the split by the vertex itself. Traces are compared lexicographically, like the node invariants in Nautyyy.
+     * If compare_trace points to the trace of the greatest node found on the same level, the trace is compared with it
+     * event by event. As soon as it is smaller, the refinement stops early and trace_aborted is set, since the node
+     * would be pruned anyway (as in Traces, (2013) McKay).
+     */
+    bool use_trace = false;
+    std::vector<std::uint64_t> trace;
+    const std::vector<std::uint64_t>* compare_trace = nullptr;
+    bool trace_aborted = false;
+
 };
 
 
@@ -37,101 +37,445 @@ Permutation perm_composition(const Permutation& first_perm, const Permutation& s
     return product;
 }
 
-std::vector<unsigned int> apply_perm(std::vector<unsigned int> vector, const Permutation& perm) {
-    for(unsigned & i : vector){
-        if(i>= perm.size()){
-            throw std::runtime_error("Elements of the subset are out of range of the permutation.");
+Graph perm_graph(const Graph& graph, const Permutation& perm) {
+    if(graph.nof_vertices() != perm.size()){
+        throw std::runtime_error("Size of graph and permutation do not match.");
+    }
+    SparseBuilder perm_graph = SparseBuilder(graph.nof_vertices());
+    perm_graph.reserve(graph.nof_edges());
+
+    for(size_t i=0, max = graph.nof_vertices(); i<max; i++){
+        for(Vtype j : graph.neighbors(i)){
+            if(static_cast<Vtype>(i) < j) {                                      //every undirected edge only once
+                perm_graph.add_edge(perm[i], perm[j]);
+            }
         }
-        i = perm[i];                                             //sends each element ot its image under the permutation
     }
-    return vector;
+    return perm_graph.freeze();
 }
 
-void print_perm(const Permutation& perm) {                           //prints a permutation in it's cycle representation
 
-    if(all_of(perm.begin(), perm.end(), [perm](unsigned int i){return perm[i]==i;})){
-        std::cout<<"Identity"<<std::endl;                                                     //the identity permutation
-        return;
-    }
-    std::vector<unsigned int> visited(perm.size(), 0);
-    int temp;
-    for(size_t i=0, max = visited.size(); i<max; i++) {
-        if ((not visited[i]) and (perm[i]!=i)) {                //extra condition to exclude elements sent to themselves
-            temp = i;
-            visited[i]=1;
-            std::cout<<"("<<i;
-            while(perm[temp] != i){          //while not back at firs element of cycle, go through elements of the cycle
-                temp=perm[temp];
-                std::cout<<" "<<temp;
-                visited[temp]=1;
-            }std::cout<<")";
+
+
+
+bool is_fixed(const Permutation& perm, const std::vector<unsigned int> &sequence){
+    for(const unsigned int& i: sequence){
+        if(perm[i] != i){
+            return false;
         }
     }
-    std::cout<<std::endl;
+    return true;
 }
 
 
-Graph perm_graph(const Graph& graph, const Permutation& perm) {
-    if(graph.nof_vertices() != perm.size()){
-        throw std::runtime_error("Size of graph and permutation do not match.");
-    }
-    Graph perm_graph = Graph(graph.nof_vertices());
 
-    for(size_t i=0, max = graph.nof_vertices(); i<max; i++){
-        for(Vtype j : graph.vertices[i].edges){
-            perm_graph.add_edge(perm[i], perm[j]);
+SparsePermutation::SparsePermutation(unsigned int num_points)
+        : num_points(num_points), support(), images(){
+
+}
+
+SparsePermutation::SparsePermutation(const Permutation& perm)
+        : num_points(perm.size()), support(), images(){
+    std::size_t num_moved = 0;                                        //counted first, so both are allocated only once
+    for(unsigned int point=0; point<perm.size(); point++){
+        num_moved += perm[point] != point;
+    }
+    support.reserve(num_moved);
+    images.reserve(num_moved);
+    for(unsigned int point=0; point<perm.size(); point++){
+        if(perm[point] != point){
+            support.push_back(point);
+            images.push_back(perm[point]);
         }
     }
-    return perm_graph;
 }
 
+SparsePermutation::SparsePermutation(unsigned int num_points, std::vector<unsigned int> support,
+                                     std::vector<unsigned int> images)
+        : num_points(num_points), support(std::move(support)), images(std::move(images)){
 
+}
 
+SparsePermutation::SparsePermutation(unsigned int num_points, std::vector<std::pair<unsigned int, unsigned int>> moved)
+        : num_points(num_points), support(), images(){
+    std::sort(moved.begin(), moved.end());
+    for(const std::pair<unsigned int, unsigned int>& point: moved){
+        support.push_back(point.first);
+        images.push_back(point.second);
+    }
+}
 
+unsigned int SparsePermutation::nof_points() const {
+    return num_points;
+}
 
-bool is_fixed(const Permutation& perm, const std::vector<unsigned int> &sequence){
+const std::vector<unsigned int>& SparsePermutation::moved_points() const {
+    return support;
+}
+
+const std::vector<unsigned int>& SparsePermutation::moved_images() const {
+    return images;
+}
+
+unsigned int SparsePermutation::image(unsigned int point) const {
+    auto found = std::lower_bound(support.begin(), support.end(), point);
+    if(found == support.end() or *found != point){                                       //not in the support, fixed
+        return point;
+    }
+    return images[found - support.begin()];
+}
+
+Permutation SparsePermutation::to_permutation() const {
+    Permutation perm(num_points);
+    std::iota(perm.begin(), perm.end(), 0);
+    for(std::size_t i=0; i<support.size(); i++){
+        perm[support[i]] = images[i];
+    }
+    return perm;
+}
+
+SparsePermutation perm_inverse(const SparsePermutation& perm) {
+    std::vector<std::pair<unsigned int, unsigned int>> moved;                         //each image goes back to its point
+    for(std::size_t i=0; i<perm.moved_points().size(); i++){
+        moved.emplace_back(perm.moved_images()[i], perm.moved_points()[i]);
+    }
+    return SparsePermutation(perm.nof_points(), std::move(moved));
+}
+
+SparsePermutation perm_composition(const SparsePermutation& first_perm, const SparsePermutation& second_perm) {
+    if(first_perm.nof_points() != second_perm.nof_points()){
+        throw std::runtime_error("Permutations are not of the same size.");
+    }
+    std::vector<unsigned int> candidates;                         //only points moved by one of them can be moved at all
+    std::set_union(first_perm.moved_points().begin(), first_perm.moved_points().end(),
+                   second_perm.moved_points().begin(), second_perm.moved_points().end(),
+                   std::back_inserter(candidates));
+    std::vector<unsigned int> support, images;
+    for(unsigned int point: candidates){
+        unsigned int image = second_perm.image(first_perm.image(point));
+        if(image != point){
+            support.push_back(point);
+            images.push_back(image);
+        }
+    }
+    return SparsePermutation(first_perm.nof_points(), std::move(support), std::move(images));
+}
+
+bool is_fixed(const SparsePermutation& perm, const std::vector<unsigned int>& sequence) {
     for(const unsigned int& i: sequence){
-        if(perm[i] != i){
+        if(perm.image(i) != i){
             return false;
         }
     }
     return true;
 }
 
-PermGroup subgroup_fixing_sequence(const PermGroup &permutations, const std::vector<unsigned int> &sequence) {
-    PermGroup subgroup = PermGroup();
-    for(const Permutation& perm: permutations){
-        if(is_fixed(perm, sequence)){
-            subgroup.push_back(perm);                                             //perm fixes sequence, add to subgroup
+std::vector<unsigned int> min_cycle_representatives(const SparsePermutation& perm) {
+    const std::vector<unsigned int>& support = perm.moved_points();
+    std::vector<unsigned int> representatives;
+    std::vector<bool> visited(support.size(), false);
+    for(std::size_t i=0; i<support.size(); i++){
+        if(visited[i]){
+            continue;
+        }
+        representatives.push_back(support[i]);           //the support is ascending, so this is the smallest of its cycle
+        for(std::size_t k=i; not visited[k];
+            k = std::lower_bound(support.begin(), support.end(), perm.moved_images()[k]) - support.begin()){
+            visited[k] = true;
+        }
+    }
+    return representatives;
+}
+
+
+OrbitPartition::OrbitPartition(unsigned int num_points): parent(num_points) {
+    std::iota(parent.begin(), parent.end(), 0);
+}
+
+unsigned int OrbitPartition::find(unsigned int point) {
+    while(parent[point] != point){
+        parent[point] = parent[parent[point]];                                   //path halving keeps the trees flat
+        point = parent[point];
+    }
+    return point;
+}
+
+void OrbitPartition::unite(unsigned int first, unsigned int second) {
+    first = find(first);
+    second = find(second);
+    if(first != second){
+        parent[std::max(first, second)] = std::min(first, second);            //the smaller root stays representative
+    }
+}
+
+void OrbitPartition::add_permutation(const Permutation& perm) {
+    for(unsigned int point=0; point<perm.size(); point++){
+        if(perm[point] != point){
+            unite(point, perm[point]);
+        }
+    }
+}
+
+void OrbitPartition::add_permutation(const SparsePermutation& perm) {
+    for(std::size_t i=0; i<perm.moved_points().size(); i++){
+        unite(perm.moved_points()[i], perm.moved_images()[i]);
+    }
+}
+
+bool OrbitPartition::is_representative(unsigned int point) {
+    return find(point) == point;
+}
+
+
+AutomorphismStore::AutomorphismStore(unsigned int num_points, unsigned int capacity)
+        : num_points(num_points), capacity(capacity), automorphisms(), min_cycle_reps(), oldest(0), num_overwritten(0){
+
+}
+
+void AutomorphismStore::add(const SparsePermutation& perm) {
+    if(capacity == 0 or automorphisms.size() < capacity){
+        automorphisms.push_back(perm);
+        min_cycle_reps.push_back(min_cycle_representatives(perm));
+        return;
+    }
+    automorphisms[oldest] = perm;                                  //full, the oldest permutation makes room
+    min_cycle_reps[oldest] = min_cycle_representatives(perm);
+    oldest = (oldest + 1) % capacity;
+    num_overwritten++;
+}
+
+std::size_t AutomorphismStore::size() const {
+    return automorphisms.size();
+}
+
+bool AutomorphismStore::empty() const {
+    return automorphisms.empty();
+}
+
+std::vector<SparsePermutation>::const_iterator AutomorphismStore::begin() const {
+    return automorphisms.begin();
+}
+
+std::vector<SparsePermutation>::const_iterator AutomorphismStore::end() const {
+    return automorphisms.end();
+}
+
+const std::vector<SparsePermutation>& AutomorphismStore::permutations() const {
+    return automorphisms;
+}
+
+PermGroup AutomorphismStore::dense_permutations() const {
+    PermGroup dense;
+    for(const SparsePermutation& perm: automorphisms){
+        dense.push_back(perm.to_permutation());
+    }
+    return dense;
+}
+
+bool AutomorphismStore::fixes(std::size_t index, const std::vector<unsigned int>& sequence) const {
+    return is_fixed(automorphisms[index], sequence);
+}
+
+void AutomorphismStore::add_to_orbits(std::size_t index, OrbitPartition& orbits) const {
+    const SparsePermutation& perm = automorphisms[index];
+    const std::vector<unsigned int>& representatives = min_cycle_reps[index];
+    std::size_t next_representative = 0;                  //both lists are ascending, so they are walked side by side
+    for(std::size_t i=0; i<perm.moved_points().size(); i++){
+        unsigned int point = perm.moved_points()[i];
+        if(next_representative < representatives.size() and representatives[next_representative] == point){
+            next_representative++;
+            continue;
+        }
+        orbits.unite(point, perm.moved_images()[i]);
+    }
+}
+
+unsigned int AutomorphismStore::nof_overwritten() const {
+    return num_overwritten;
+}
+
+std::size_t AutomorphismStore::nof_added() const {
+    return automorphisms.size() + num_overwritten;
+}
+
+std::size_t AutomorphismStore::index_of(std::size_t number) const {
+    return capacity == 0 ? number : number % capacity;                      //once full, they go round and round
+}
+
+
+const unsigned int StabilizerChain::base_root;
+const unsigned int StabilizerChain::not_in_orbit;
+const unsigned int StabilizerChain::sifts_to_stop;
+const unsigned int StabilizerChain::random_walk_steps;
+const std::uint64_t StabilizerChain::max_schreier_test_work;
+
+StabilizerChain::StabilizerChain(unsigned int num_points, std::vector<unsigned int> base)
+        : num_points(num_points), base(std::move(base)), generators(), inverses(), level_of(),
+          schreier(), orbits(), orbits_outdated(), random_element(num_points), random(5489u){
+    for(unsigned int level=0; level<this->base.size(); level++){
+        schreier.emplace_back(num_points, not_in_orbit);
+        schreier.back()[this->base[level]] = base_root;
+        orbits.emplace_back(num_points);
+        orbits_outdated.push_back(false);
+    }
+    std::iota(random_element.begin(), random_element.end(), 0);
+}
+
+Permutation StabilizerChain::sift(Permutation perm, unsigned int& level) const {
+    for(level=0; level<base.size(); level++){
+        unsigned int image = perm[base[level]];
+        if(schreier[level][image] == not_in_orbit){
+            return perm;
+        }
+        while(schreier[level][image] != base_root){           //walk up the orbit tree, undoing one generator at a time
+            const Permutation& inverse = inverses[schreier[level][image]];
+            for(unsigned int& point: perm){
+                point = inverse[point];
+            }
+            image = perm[base[level]];
+        }
+    }
+    return perm;
+}
+
+void StabilizerChain::build_orbit_tree(unsigned int level) {
+    std::vector<unsigned int>& tree = schreier[level];
+    std::fill(tree.begin(), tree.end(), not_in_orbit);
+    tree[base[level]] = base_root;
+    std::vector<unsigned int> queue{base[level]};
+    for(std::size_t next=0; next<queue.size(); next++){
+        for(unsigned int k=0; k<generators.size(); k++){
+            if(level_of[k] < level){                                           //the generator does not lie in G_level
+                continue;
+            }
+            unsigned int image = generators[k][queue[next]];
+            if(tree[image] == not_in_orbit){
+                tree[image] = k;
+                queue.push_back(image);
+            }
         }
     }
-    return  subgroup;
 }
 
+void StabilizerChain::add_strong_generator(const Permutation& perm, unsigned int level) {
+    generators.push_back(perm);
+    inverses.push_back(perm_inverse(perm));
+    level_of.push_back(level);
+    for(unsigned int i=0; i<=level and i<base.size(); i++){
+        build_orbit_tree(i);
+        orbits_outdated[i] = true;
+    }
+}
 
-//! needs comments
-std::vector<unsigned int> mcrs(const PermGroup &permutations, const std::vector<unsigned int> &sequence) {
-    if(permutations.empty()){
-        throw std::runtime_error("There are no permutations.");
+bool StabilizerChain::add_generator(const Permutation& perm) {
+    unsigned int level;
+    Permutation rest = sift(perm, level);
+    if(level == base.size()){                                                          //perm already lies in the group
+        return false;
+    }
+    add_strong_generator(rest, level);
+    for(unsigned int sifted_through = 0; sifted_through < sifts_to_stop;){
+        for(unsigned int step=0; step<random_walk_steps; step++){
+            std::uniform_int_distribution<std::size_t> pick(0, generators.size() - 1);
+            random_element = perm_composition(random_element, generators[pick(random)]);
+        }
+        rest = sift(random_element, level);
+        if(level == base.size()){
+            sifted_through++;
+        }
+        else{                                                     //the chain was incomplete, the rest extends it
+            add_strong_generator(rest, level);
+            sifted_through = 0;
+        }
+    }
+    return true;
+}
+
+Permutation StabilizerChain::representative(unsigned int level, unsigned int point) const {
+    std::vector<unsigned int> path;                                       //the generators from point up to the root
+    while(schreier[level][point] != base_root){
+        path.push_back(schreier[level][point]);
+        point = inverses[schreier[level][point]][point];
+    }
+    Permutation product(num_points);
+    std::iota(product.begin(), product.end(), 0);
+    for(auto k = path.rbegin(); k != path.rend(); k++){
+        product = perm_composition(product, generators[*k]);
     }
+    return product;
+}
 
-    std::vector<unsigned int> result = std::vector<unsigned int>();
-    std::vector<unsigned int> visited(permutations[0].size(), 0);
-    PermGroup subgroup = subgroup_fixing_sequence(permutations, sequence);
-    int temp;
-    for(size_t i=0, max = visited.size(); i<max; i++) {
-        if (not visited[i]){
-            visited[i]=1;
-            result.push_back(i);
-            for(const Permutation& perm: subgroup) {
-                temp = i;
-                while (perm[temp] != i) {
-                    temp = perm[temp];
-                    visited[temp] = 1;
+bool StabilizerChain::verify() {
+    std::uint64_t work = 0;
+    unsigned int level = base.size();
+    while(level > 0){                             //the levels below the current one are known to be complete already
+        level--;
+        bool extended = false;
+        for(unsigned int point=0; point<num_points and not extended; point++){
+            if(schreier[level][point] == not_in_orbit){
+                continue;
+            }
+            Permutation coset_representative = representative(level, point);
+            for(unsigned int k=0; k<generators.size() and not extended; k++){
+                if(level_of[k] < level){                                       //the generator does not lie in G_level
+                    continue;
+                }
+                work += std::uint64_t(num_points) * (base.size() - level + 1);
+                if(work > max_schreier_test_work){
+                    return false;
+                }
+                unsigned int sifted_level;
+                Permutation rest = sift(perm_composition(coset_representative, generators[k]), sifted_level);
+                if(sifted_level < base.size()){                      //the chain was incomplete, the rest extends it
+                    add_strong_generator(rest, sifted_level);
+                    extended = true;
                 }
             }
         }
+        if(extended){                                     //the orbit trees up to the new generator changed, start over
+            level = base.size();
+        }
     }
-    return result;
+    return true;
 }
 
+OrbitPartition& StabilizerChain::orbits_at(unsigned int level) {
+    if(orbits_outdated[level]){
+        orbits[level] = OrbitPartition(num_points);
+        for(unsigned int k=0; k<generators.size(); k++){
+            if(level_of[k] >= level){
+                orbits[level].add_permutation(generators[k]);
+            }
+        }
+        orbits_outdated[level] = false;
+    }
+    return orbits[level];
+}
+
+const PermGroup& StabilizerChain::strong_generators() const {
+    return generators;
+}
+
+std::string StabilizerChain::order() const {
+    const std::uint64_t limb_base = 1000000000;
+    std::vector<std::uint64_t> limbs{1};                            //the order in base 10^9, least significant first
+    for(const std::vector<unsigned int>& tree: schreier){
+        std::uint64_t orbit_length = num_points - std::count(tree.begin(), tree.end(), not_in_orbit);
+        std::uint64_t carry = 0;
+        for(std::uint64_t& limb: limbs){
+            std::uint64_t product = limb * orbit_length + carry;
+            limb = product % limb_base;
+            carry = product / limb_base;
+        }
+        while(carry){
+            limbs.push_back(carry % limb_base);
+            carry /= limb_base;
+        }
+    }
+    std::string digits = std::to_string(limbs.back());
+    for(auto limb = limbs.rbegin() + 1; limb != limbs.rend(); limb++){
+        std::string part = std::to_string(*limb);
+        digits += std::string(9 - part.size(), '0') + part;
+    }
+    return digits;
+}
@@ -6,8 +6,8 @@
 /*
  * permutation group.h
  * Purpose: Elementary handling of permutations such as composition and inverses, also
- * application of permutations to subsets of [n] or graphs and basic operations on permutations group such as finding
- * stabilisors and orbits (more exactly, minimum cell representations).
+ * application of permutations to graphs and basic operations on permutations groups such as finding orbits of
+ * stabilizers, see OrbitPartition, AutomorphismStore and StabilizerChain.
  * */
 
 #include <vector>
@@ -15,6 +15,10 @@
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <random>
+#include <string>
+#include <limits>
+#include <iterator>
 
 #include "sparse_graph.h"
 #include "partition and refinement.h"
@@ -54,23 +58,6 @@ Permutation perm_inverse(const Permutation& perm);
  */
 Permutation perm_composition(const Permutation& first_perm, const Permutation& second_perm);
 
-/*
- * apply_perm(vector, perm) Permutes the elements of vector by the given permutation
- *
- * Parameter: vector A subset with elements smaller than the size of the permutation
- *            perm A permutation
- * Returns: The subset with the elements permuted
- */
-std::vector<unsigned int> apply_perm(std::vector<unsigned int> vector, const Permutation& perm);
-
-/*
- * print_perm(perm) Outputs the permutation in cycle notation. That means only elements that move something are
- *                  printed and the permutation that moves nothing is 'Identity', output as such.
- *
- * Parameter: A permutation
- */
-void print_perm(const Permutation& perm);
-
 /*
  * perm_graph(graph, perm) Applies the permutation to the adjacency matrix of the graph
  *
@@ -94,26 +81,206 @@ Graph perm_graph(const Graph& graph, const Permutation& perm);
  */
 bool is_fixed(const Permutation& perm, const std::vector<unsigned int> &sequence);
 
-//stabilizer
 /*
- * subgroup_fixing_sequence(permutations, sequence)
+ * SparsePermutation
+ * Purpose: A permutation stored by its support only, the points it moves, together with their images. Most
+ * automorphisms of the graphs we search move a small part of the vertices, so memory and the cost of composing, inverting
+ * or testing them scale with the size of the support instead of the number of points
  *
- * Parameter: A vector of permutations and a sequence of integers
+ * Member variables:
+ * num_points: the number of points the permutation acts on
+ * support: the moved points, ascending
+ * images: images[i] is the image of support[i]
  *
- * Returns: A subvector of permutations all of which fix the sequence
+ * SparsePermutation(n): The identity on n points
+ * SparsePermutation(perm): The sparse form of a permutation given as integer vector
+ * SparsePermutation(n, support, images): The permutation moving the ascending points of support to images
+ * SparsePermutation(n, moved): The permutation sending moved[i].first to moved[i].second, in any order
+ * nof_points(): The number of points it acts on
+ * moved_points(), moved_images(): The support and the images of its points, in the same order
+ * image(point): The image of point, found by binary search in the support
+ * to_permutation(): The permutation as integer vector
  */
-PermGroup subgroup_fixing_sequence(const PermGroup &permutations, const std::vector<unsigned int> &sequence);
+class SparsePermutation{
+    unsigned int num_points;
+    std::vector<unsigned int> support;
+    std::vector<unsigned int> images;
+public:
+    explicit SparsePermutation(unsigned int num_points = 0);
+    explicit SparsePermutation(const Permutation& perm);
+    SparsePermutation(unsigned int num_points, std::vector<unsigned int> support, std::vector<unsigned int> images);
+    SparsePermutation(unsigned int num_points, std::vector<std::pair<unsigned int, unsigned int>> moved);
+    unsigned int nof_points() const;
+    const std::vector<unsigned int>& moved_points() const;
+    const std::vector<unsigned int>& moved_images() const;
+    unsigned int image(unsigned int point) const;
+    Permutation to_permutation() const;
+};
 
-//minimum cell representatives, orbits
 /*
- * mcrs(permutations, sequence, num_vertices)
+ * perm_inverse(perm), perm_composition(first_perm, second_perm), is_fixed(perm, sequence)
  *
- * Parameter: A vector of permutations and a sequence of integers
+ * The same as for permutations as integer vectors, see above, but in time linear in the size of the supports, up to a
+ * logarithmic factor for looking up images
+ */
+SparsePermutation perm_inverse(const SparsePermutation& perm);
+SparsePermutation perm_composition(const SparsePermutation& first_perm, const SparsePermutation& second_perm);
+bool is_fixed(const SparsePermutation& perm, const std::vector<unsigned int>& sequence);
+
+/*
+ * min_cycle_representatives(perm)
  *
- * Returns: An approximate minimum cell representation
+ * Parameter: A permutation
+ *
+ * Returns: The smallest point of each cycle of perm that is not a fixed point, ascending
  */
-std::vector<unsigned int> mcrs(const PermGroup& permutations, const std::vector<unsigned int> &sequence);
+std::vector<unsigned int> min_cycle_representatives(const SparsePermutation& perm);
 
 //for more efficiency, faster search for stabilizers and computation of orbits
+/*
+ * OrbitPartition
+ * Purpose: The orbits of the group generated by some permutations as a union-find structure to which the permutations
+ * are added one by one, so the orbits need not be recomputed from all of them. The representative of an orbit is its
+ * smallest element, so the representatives are the minimum cell representatives of the orbits, and pruning keeps
+ * only the children of a node that are representatives
+ *
+ * OrbitPartition(n): The orbits of the trivial group on n points, i.e. singletons
+ * find(point): The smallest element of the orbit of point, halving the path to it on the way
+ * unite(first, second): Merges the orbits of the two points
+ * add_permutation(perm): Merges the orbit of each point with the one of its image under perm, for a SparsePermutation
+ *                       only the moved points are visited
+ * is_representative(point): Whether point is the smallest element of its orbit
+ */
+class OrbitPartition{
+    std::vector<unsigned int> parent;
+public:
+    explicit OrbitPartition(unsigned int num_points);
+    unsigned int find(unsigned int point);
+    void unite(unsigned int first, unsigned int second);
+    void add_permutation(const Permutation& perm);
+    void add_permutation(const SparsePermutation& perm);
+    bool is_representative(unsigned int point);
+};
+
+/*
+ * AutomorphismStore
+ * Purpose: Keeps at most capacity permutations as SparsePermutations, each with nauty style precomputed records: its
+ * support and the minimum cycle representatives, i.e. the smallest point of each of its cycles. Whether a permutation
+ * fixes a sequence pointwise is looked up in its support, point by point of the sequence. Once full, a new permutation
+ * overwrites the oldest one, so the memory stays bounded while the most recent ones, the most relevant for the current
+ * subtree, stay. Everything stored scales with the supports, not with the number of points. The memory of a
+ * StabilizerChain the permutations are sifted into is not bounded by capacity, see there
+ *
+ * AutomorphismStore(num_points, capacity): An empty store, capacity 0 means it keeps all permutations
+ * add(perm): Stores perm and its records, overwriting the oldest permutation if the store is full
+ * size(), empty(), begin(), end(), permutations(): Access to the stored permutations
+ * dense_permutations(): The stored permutations as integer vectors
+ * fixes(index, sequence): Whether the permutation at index fixes all points of the sequence
+ * add_to_orbits(index, orbits): Merges the orbits of the permutation at index into orbits, going over its moved points
+ *                              except the minimum cycle representatives, which are merged already by the rest of the
+ *                              cycle
+ * nof_overwritten(): How many permutations were overwritten because the store was full
+ * nof_added(): How many permutations were added in total, the overwritten ones included
+ * index_of(number): The index of the permutation added as the number-th, counting from 0, which has to be one of the
+ *                   last size() added
+ */
+class AutomorphismStore{
+    unsigned int num_points;
+    unsigned int capacity;
+    std::vector<SparsePermutation> automorphisms;
+    std::vector<std::vector<unsigned int>> min_cycle_reps;
+    std::size_t oldest;
+    unsigned int num_overwritten;
+public:
+    explicit AutomorphismStore(unsigned int num_points = 0, unsigned int capacity = 0);
+    void add(const SparsePermutation& perm);
+    std::size_t size() const;
+    bool empty() const;
+    std::vector<SparsePermutation>::const_iterator begin() const;
+    std::vector<SparsePermutation>::const_iterator end() const;
+    const std::vector<SparsePermutation>& permutations() const;
+    PermGroup dense_permutations() const;
+    bool fixes(std::size_t index, const std::vector<unsigned int>& sequence) const;
+    void add_to_orbits(std::size_t index, OrbitPartition& orbits) const;
+    unsigned int nof_overwritten() const;
+    std::size_t nof_added() const;
+    std::size_t index_of(std::size_t number) const;
+};
+
+/*
+ * StabilizerChain
+ * Purpose: A base and strong generating set of the group generated by the permutations added to it, kept up to date
+ * by the randomized Schreier-Sims algorithm. With G_i the pointwise stabilizer of the first i base points, the strong
+ * generators in G_i generate G_i, so the orbits of G_i are exact and the order of the group is the product of the
+ * lengths of the orbits of the base points. For reference see (2003) Seress, Permutation Group Algorithms, 4.3
+ *
+ * Member variables:
+ * num_points: the number of points the permutations act on
+ * base: points that only the identity fixes all at once, e.g. the vertex sequence of a leaf of the search tree
+ * generators, inverses: the strong generators and their inverses. Each of them enlarged the stabilizer of the level
+ *                      it was added at, at least doubling its order, so there are at most log2 of the group order of
+ *                      them for each base point. They are not bounded otherwise, since dropping one loses a subgroup
+ * level_of: for each strong generator the number of leading base points it fixes, so it lies in G_i up to that i
+ * schreier: for each level i and each point the strong generator mapping its parent in the orbit tree of base[i] under
+ *           G_i to it, base_root for base[i] itself and not_in_orbit for the points outside the orbit
+ * orbits: for each level i the orbits of G_i, built when first needed after the generators changed
+ * orbits_outdated: for each level whether orbits has to be rebuilt
+ * random_element: the current state of a random walk through the group, giving the random elements to sift
+ * random: the source of randomness, with a fixed seed so that searches are reproducible
+ *
+ * StabilizerChain(num_points, base): The chain of the trivial group with the given base
+ * add_generator(perm): Sifts perm through the chain. If it is not in the group yet, the rest is added as a strong
+ *                      generator and random elements are sifted until sifts_to_stop of them in a row sift through,
+ *                      which makes the chain complete with high probability. Returns whether the group grew
+ * orbits_at(level): The orbits of G_level, the stabilizer of the first level base points
+ * strong_generators(): The strong generators, which generate the group
+ * verify(): Runs the deterministic Schreier test, level by level from the deepest: every Schreier generator, the
+ *           product of a coset representative and a strong generator divided by the representative of its image, has to
+ *           sift through the deeper levels. The rest of one that does not is added as a strong generator and the test
+ *           starts over. Returns true if it finished within max_schreier_test_work, then the chain is complete
+ * order(): The order of the group as a decimal number of arbitrary length. If the chain is incomplete, this is the
+ *          order of a subgroup, so it is never too large. After verify() returned true it is exact
+ */
+class StabilizerChain{
+    static const unsigned int base_root = std::numeric_limits<unsigned int>::max();
+    static const unsigned int not_in_orbit = std::numeric_limits<unsigned int>::max() - 1;
+    static const unsigned int sifts_to_stop = 10;
+    static const unsigned int random_walk_steps = 4;
+    static const std::uint64_t max_schreier_test_work = std::uint64_t(1) << 28;    //in points of sifted permutations
+
+    unsigned int num_points;
+    std::vector<unsigned int> base;
+    PermGroup generators;
+    PermGroup inverses;
+    std::vector<unsigned int> level_of;
+    std::vector<std::vector<unsigned int>> schreier;
+    std::vector<OrbitPartition> orbits;
+    std::vector<bool> orbits_outdated;
+    Permutation random_element;
+    std::mt19937 random;
+
+    /*
+     * sift(perm, level) Divides perm by the coset representatives level by level while it maps the base point into its
+     *                   orbit. Returns the rest, level is set to the level where this failed or to the length of the
+     *                   base if perm sifted through, in which case the rest is the identity
+     * add_strong_generator(perm, level) Adds perm, which fixes the first level base points, and updates the orbit trees
+     *                                   of all levels up to level
+     * build_orbit_tree(level) Computes schreier[level] by breadth first search from base[level]
+     * representative(level, point) The product of the strong generators on the path from base[level] to point in the
+     *                              orbit tree of level, which maps base[level] to point
+     */
+    Permutation sift(Permutation perm, unsigned int& level) const;
+    void add_strong_generator(const Permutation& perm, unsigned int level);
+    void build_orbit_tree(unsigned int level);
+    Permutation representative(unsigned int level, unsigned int point) const;
+
+public:
+    StabilizerChain(unsigned int num_points, std::vector<unsigned int> base);
+    bool add_generator(const Permutation& perm);
+    OrbitPartition& orbits_at(unsigned int level);
+    bool verify();
+    std::string order() const;
+    const PermGroup& strong_generators() const;
+};
 
 #endif //NAUTY_PERMUTATION_GROUP_H
@@ -1,165 +1,209 @@
 #include "sparse_graph.h"
+#include "graph_io.h"
 
 
-Sparse::Vertex::Vertex():edges(std::set<Vtype>()) {
+const unsigned int Sparse::no_color;
+
+
+SparseBuilder::SparseBuilder(unsigned int num_vertices): num_vertices(num_vertices),
+                                                       edges(std::vector<std::pair<Vtype, Vtype>>()){
 
 }
 
-void Sparse::Vertex::add_edge(const Vtype vertex) {
-    edges.insert(vertex);
+void SparseBuilder::add_edge(Vtype v1, Vtype v2){
+    edges.emplace_back(v1, v2);                               //stored once, both directions are created when freezing
 }
 
-unsigned int Sparse::Vertex::nof_edges() const{
-    return edges.size();
+void SparseBuilder::add_edges(const std::vector<std::pair<Vtype, Vtype>>& more_edges){
+    edges.insert(edges.end(), more_edges.begin(), more_edges.end());
 }
 
-void Sparse::add_edge(Vtype v1, Vtype v2){
-    vertices[v1].add_edge(v2);
-    vertices[v2].add_edge(v1);
+void SparseBuilder::reserve(unsigned int num_edges){
+    edges.reserve(num_edges);
 }
 
-unsigned int Sparse::nof_vertices() const {
-    return vertices.size();
+unsigned int SparseBuilder::nof_vertices() const {
+    return num_vertices;
 }
 
-Sparse::Sparse(unsigned int num_vertices): vertices(std::vector<Vertex>(num_vertices)){
+Sparse SparseBuilder::freeze() const{
+    std::shared_ptr<SparseStorage> storage = std::make_shared<SparseStorage>();
+    std::vector<unsigned int>& offsets = storage->offsets;
+    std::vector<Vtype>& adjacency = storage->adjacency;
+    offsets.assign(num_vertices + 1, 0);
 
+    for(const std::pair<Vtype, Vtype>& edge: edges){                              //count the degree of every vertex
+        offsets[edge.first + 1]++;
+        offsets[edge.second + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());        //prefix sums give the row offsets
+    adjacency.resize(offsets.back());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end()-1);           //next free position in every row
+    for(const std::pair<Vtype, Vtype>& edge: edges){
+        adjacency[fill[edge.first]++] = edge.second;
+        adjacency[fill[edge.second]++] = edge.first;
+    }
+                                           //sort every row and drop parallel edges, compacting the arrays in place
+    unsigned int write = 0;
+    for(unsigned int v=0; v<num_vertices; v++){
+        std::vector<Vtype>::iterator row_begin = adjacency.begin() + offsets[v];
+        std::vector<Vtype>::iterator row_end = adjacency.begin() + offsets[v+1];
+        std::sort(row_begin, row_end);
+        row_end = std::unique(row_begin, row_end);
+        offsets[v] = write;
+        write = std::copy(row_begin, row_end, adjacency.begin() + write) - adjacency.begin();
+    }
+    offsets[num_vertices] = write;
+    adjacency.resize(write);
+    adjacency.shrink_to_fit();
+
+    if(not initial_partition.empty()){                                       //the i-th cell becomes the i-th color
+        storage->colors.assign(num_vertices, Sparse::no_color);
+        for(unsigned int cell=0; cell<initial_partition.size(); cell++){
+            for(unsigned int vertex: initial_partition[cell]){
+                storage->colors[vertex] = cell;
+            }
+        }
+    }
+    const unsigned int* colors = storage->colors.empty() ? nullptr : storage->colors.data();
+    return Sparse(storage, num_vertices, storage->offsets.data(), storage->adjacency.data(), colors);
 }
 
-Sparse::Sparse(const char *filename) {
-    std::ifstream file(filename);
-    if (not file) {                                                                                   //wrong file input
-        throw std::runtime_error("Cannot open file.");
-    }
 
-    std::string line;
-    std::getline(file, line);                                                     //read in the file line by line
+unsigned int Sparse::nof_vertices() const {
+    return num_vertices;
+}
 
-    if(isalpha(line[0])){                                                                  //file is of dimacs format
-        dimacs(filename);
-        return;
-    }
+unsigned int Sparse::nof_edges() const {
+    return offsets[num_vertices] / 2;
+}
 
-    std::stringstream ss(line);
-    int num_nodes = 0;
-    ss >> num_nodes;
-    if (not ss) {                            //first line must contain a single number, the number of nodes of the graph
-        throw std::runtime_error("No number of vertices given, invalid file format.");
+std::vector<std::vector<unsigned int>> Sparse::initial_partition() const {
+    std::vector<std::vector<unsigned int>> partition;
+    if(not is_colored()){
+        return partition;
+    }
+    std::vector<unsigned int> by_color;
+    for(unsigned int v=0; v<num_vertices; v++){
+        if(colors[v] != no_color){
+            by_color.push_back(v);
+        }
     }
-    //matrix with n row and columns is initialised, every entry 0
-    vertices.resize(num_nodes);
-    line = std::string();
-    std::getline(file, line);
-    if(line.empty()){
-        return;
+    std::stable_sort(by_color.begin(), by_color.end(),               //ordered by color, ascending vertices per cell
+            [this](unsigned int a, unsigned int b){return colors[a] < colors[b];});
+    for(size_t i=0; i<by_color.size(); i++){
+        if(i == 0 or colors[by_color[i]] != colors[by_color[i-1]]){
+            partition.emplace_back();
+        }
+        partition.back().push_back(by_color[i]);
     }
+    return partition;
+}
 
-    auto space_pos = std::find_if(line.begin(), line.end(), isspace);
-    //when there is a space in the right place, it is of format 1. Exception that space is encountered at end is handled
-    if(space_pos != line.end() and (std::next(space_pos,1) != line.end())){                     //File is of Format 1
-        do{
-            ss.clear();
-            ss.str(std::string());
-            ss << line;
-            int tail, head;
-            ss >> tail >> head;
-            if (not ss) {                                                          //each line must give a tail and head
-                throw std::runtime_error("Invalid file format, not the correct edge format.");
-            }
-            if (tail != head) {                                                     //graph is supposed to be undirected
-                add_edge(tail,head);
-            }
-            else {
-                throw std::runtime_error("Invalid file format: loops and parallel edges not allowed.");
-            }
-        } while (std::getline(file, line));
-    }
-    else{                                                                                          //File is of Format 2
-        for(int tail=0; tail<num_nodes; tail++) {
-            ss.clear();
-            ss.str(std::string());
-            ss << line;
-            std::string edges;
-            ss >> edges;
-
-            if (not ss) {
-                throw std::runtime_error("Invalid file format, not enough rows given.");
-            }
-            for(int head=0; head<num_nodes; head++){
-                if(edges[tail]=='1'){
-                    throw std::runtime_error("Invalid file format: loops not allowed.");
-                }
-                if(edges[head]=='1'){
-                    add_edge(tail,head);
+std::vector<std::vector<unsigned int>> Sparse::connected_components() const {
+    std::vector<std::vector<unsigned int>> components;
+    std::vector<bool> visited(num_vertices, false);
+    for(unsigned int start=0; start<num_vertices; start++){
+        if(visited[start]){
+            continue;
+        }
+        visited[start] = true;
+        components.emplace_back(1, start);
+        std::vector<unsigned int>& component = components.back();
+        for(std::size_t next=0; next<component.size(); next++){                   //the component is the bfs queue
+            for(Vtype neighbor: neighbors(component[next])){
+                if(not visited[neighbor]){
+                    visited[neighbor] = true;
+                    component.push_back(neighbor);
                 }
             }
-            std::getline(file, line);
         }
+        std::sort(component.begin(), component.end());
     }
+    return components;
 }
 
-void Sparse::dimacs(char const* filename){
-    std::ifstream file(filename);
-    if (not file) {                                                                                   //wrong file input
-        throw std::runtime_error("Cannot open file.");
-    }
-
-    std::string line;
-    std::getline(file, line);                                                     //read in the file line by line
-
-    while(line[0] == 'c'){
-        std::getline(file, line);                                                               //ignore comments
+Sparse Sparse::induced_subgraph(const std::vector<unsigned int>& vertices) const {
+    std::unordered_map<unsigned int, unsigned int> index;
+    for(unsigned int i=0; i<vertices.size(); i++){
+        index[vertices[i]] = i;
     }
-    if(line[0] != 'p'){
-        throw std::runtime_error("File is not in correct dimacs format.");                //a different case was expected
+    SparseBuilder builder(vertices.size());
+    for(unsigned int i=0; i<vertices.size(); i++){
+        for(Vtype neighbor: neighbors(vertices[i])){
+            auto found = index.find(neighbor);
+            if(found != index.end() and i < found->second){
+                builder.add_edge(i, found->second);
+            }
+        }
     }
-    std::string p, edge;
-    int n, e;
-    std::stringstream ss(line);
-    ss >> p >> edge >> n >> e;                                                       //read in number of nodes and edges
-
-    vertices.resize(n);
-
-    std::getline(file, line);
-    char aux; unsigned int node, color;
-    std::map<unsigned int, std::vector<unsigned int>> aux_map;
-    while(line[0] == 'n'){
-        ss.clear();
-        ss.str(std::string());
-        ss << line;
-        ss >> aux >> node >> color;
-        aux_map[color].push_back(node - 1);
-
-        std::getline(file, line);
+    if(is_colored()){
+        std::vector<unsigned int> by_color;
+        for(unsigned int i=0; i<vertices.size(); i++){
+            if(colors[vertices[i]] != no_color){
+                by_color.push_back(i);
+            }
+        }
+        std::stable_sort(by_color.begin(), by_color.end(),
+                [&](unsigned int a, unsigned int b){return colors[vertices[a]] < colors[vertices[b]];});
+        for(size_t i=0; i<by_color.size(); i++){
+            if(i == 0 or colors[vertices[by_color[i]]] != colors[vertices[by_color[i-1]]]){
+                builder.initial_partition.emplace_back();
+            }
+            builder.initial_partition.back().push_back(by_color[i]);
+        }
     }
+    return builder.freeze();
+}
 
-    for(const auto& color_vec: aux_map){
-        initial_partition.push_back(color_vec.second);
+std::vector<unsigned int> Sparse::cuthill_mckee_order() const {
+    std::vector<unsigned int> by_degree(num_vertices);
+    std::iota(by_degree.begin(), by_degree.end(), 0);
+    auto smaller_degree = [this](unsigned int a, unsigned int b){return degree(a) < degree(b);};
+    std::stable_sort(by_degree.begin(), by_degree.end(), smaller_degree);
+    std::vector<unsigned int> order;
+    order.reserve(num_vertices);
+    std::vector<bool> visited(num_vertices, false);
+    for(unsigned int start: by_degree){
+        if(visited[start]){
+            continue;
+        }
+        visited[start] = true;
+        order.push_back(start);
+        for(std::size_t next=order.size()-1; next<order.size(); next++){                //order is the bfs queue
+            std::size_t first_new = order.size();
+            for(Vtype neighbor: neighbors(order[next])){
+                if(not visited[neighbor]){
+                    visited[neighbor] = true;
+                    order.push_back(neighbor);
+                }
+            }
+            std::stable_sort(order.begin() + first_new, order.end(), smaller_degree);
+        }
     }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
 
+Sparse::Sparse(unsigned int num_vertices): Sparse(SparseBuilder(num_vertices).freeze()){
 
-    int offset = 1;                                                  //in dimacs format, vertices start at 0 and go to n
-
-    char first;
-    int head, tail;
-    do {
-        ss.clear();
-        ss.str(std::string());
-        ss << line;
-        ss >> first >> head >> tail;
-        add_edge(head - offset,tail - offset);
-    }
-    while (std::getline(file, line));
 }
 
+Sparse::Sparse(std::shared_ptr<const void> storage, unsigned int num_vertices,
+               const unsigned int* offsets, const Vtype* adjacency, const unsigned int* colors)
+               : storage(std::move(storage)), num_vertices(num_vertices),
+                 offsets(offsets), adjacency(adjacency), colors(colors){
 
+}
 
+Sparse::Sparse(const char *filename): Sparse(read_graph(filename)){
 
+}
 
 void Sparse::print() const{
-    for(size_t v=0, max = vertices.size(); v<max; v++){
+    for(size_t v=0, max = nof_vertices(); v<max; v++){
         std::cout<<v<<" :";
-        for(Vtype w: vertices[v].edges){
+        for(Vtype w: neighbors(v)){
             std::cout<<" "<<w;
         }std::cout<<"."<<std::endl;
     }
@@ -170,36 +214,137 @@ int Sparse::degree(const Vtype &vertex, const std::vector<Vtype> &cell) const{
         throw std::runtime_error("Given cell is not sorted, degree calculation may go wrong.");
     }
     std::vector<Vtype> intersection{};
-    std::set_intersection(vertices[vertex].edges.begin(), vertices[vertex].edges.end(),
+    Neighbors vertex_neighbors = neighbors(vertex);
+    std::set_intersection(vertex_neighbors.begin(), vertex_neighbors.end(),
                           cell.begin(), cell.end(), std::back_inserter(intersection));
     return intersection.size();
 }
 
-std::vector<bool> Sparse::hash_value() const{
-    int n = nof_vertices();
-                                                           //could also reduce size here by indexing from strictly upper
-                                                        //triangular matrix, result would only need to be n*(n-1)/2 then
-    std::vector<bool> result(n*n, false);
-    for(int i=0; i<n; i++){
-        for(auto j: vertices[i].edges){
-            result[n * (n - i) - j-1] = true;
+Certificate Sparse::hash_value() const{
+    Permutation identity(nof_vertices());
+    std::iota(identity.begin(), identity.end(), 0);
+    return perm_hash_value(identity);
+}
+
+
+void Sparse::permuted_row(unsigned int i, const Permutation& perm, const Permutation& inverse,
+                          std::vector<std::uint32_t>& row) const{
+    row.clear();
+    for(Vtype j: neighbors(inverse[i])){
+        if(perm[j] <= i){                                                   //check existence of permuted edges instead
+            row.push_back(perm[j]);
+        }
+    }
+    std::sort(row.begin(), row.end(), std::greater<std::uint32_t>());
+}
+
+
+Certificate Sparse::perm_hash_value(const Permutation& perm) const{
+    unsigned int n = nof_vertices();
+    Permutation inverse(n);
+    for(unsigned int i=0; i<n; i++){
+        inverse[perm[i]] = i;
+    }
+    Certificate result;
+    result.reserve(1 + offsets[n] + 2 * n);                 //each edge once as a pair, loops would appear once too
+    result.push_back(n);
+    std::vector<std::uint32_t> row;
+    for(unsigned int i=n; i-- > 0;){                                    //rows of the permuted graph, descendingly
+        permuted_row(i, perm, inverse, row);
+        for(std::uint32_t j: row){
+            result.push_back(i);
+            result.push_back(j);
         }
     }
     return result;
 }
 
 
-std::vector<bool> Sparse::perm_hash_value(const Permutation& perm) const{
+std::vector<int> Sparse::compare_perm_hash_value(const Permutation& perm,
+                                                 const std::vector<const Certificate*>& others) const{
     unsigned int n = nof_vertices();
-    std::vector<bool> result(n*n, false);
+    std::vector<int> results(others.size(), 0);
+    std::vector<std::size_t> position(others.size(), 1);            //next word of each other certificate to compare
+    unsigned int undecided = 0;
+    for(std::size_t k=0; k<others.size(); k++){                                   //first word is the number of vertices
+        const Certificate& other = *others[k];
+        if(other.empty() or other[0] != n){
+            results[k] = (other.empty() or n > other[0]) ? 1 : -1;
+        }
+        else{
+            undecided++;
+        }
+    }
 
+    Permutation inverse(n);
     for(unsigned int i=0; i<n; i++){
-        for(auto j: vertices[i].edges){
-            result[n * (n - perm[i]) - perm[j]-1] = true;                    //check existence of permuted edges instead
+        inverse[perm[i]] = i;
+    }
+    std::vector<std::uint32_t> row;
+    for(unsigned int i=n; undecided and i-- > 0;){                     //rows of the permuted graph, descendingly
+        permuted_row(i, perm, inverse, row);
+        for(std::uint32_t j: row){
+            for(std::size_t k=0; k<others.size(); k++){
+                if(results[k] != 0){
+                    continue;                                                           //already differed before
+                }
+                const Certificate& other = *others[k];
+                std::size_t& pos = position[k];
+                if(pos >= other.size()){                                //other is a proper prefix, so it is smaller
+                    results[k] = 1;
+                }
+                else if(other[pos] != i){
+                    results[k] = i < other[pos] ? -1 : 1;
+                }
+                else if(other[pos+1] != j){
+                    results[k] = j < other[pos+1] ? -1 : 1;
+                }
+                pos += 2;
+                undecided -= (results[k] != 0);
+            }
+            if(not undecided){
+                break;                                                  //stop at the first difference to all others
+            }
         }
     }
-    return result;
+    for(std::size_t k=0; k<others.size(); k++){
+        if(results[k] == 0 and position[k] < others[k]->size()){                  //leaf is a proper prefix of other
+            results[k] = -1;
+        }
+    }
+    return results;
 }
 
 
+std::uint64_t Sparse::perm_fingerprint(const Permutation& perm) const{
+    unsigned int n = nof_vertices();
+    std::uint64_t fingerprint = mix_hash(n);
+    for(unsigned int v=0; v<n; v++){
+        for(Vtype w: neighbors(v)){
+            if(static_cast<Vtype>(v) <= w){                                          //every undirected edge only once
+                std::uint64_t i = std::max(perm[v], perm[w]), j = std::min(perm[v], perm[w]);
+                fingerprint += mix_hash(i << 32 | j);                     //addition makes the order of edges irrelevant
+            }
+        }
+    }
+    return fingerprint;
+}
+
 
+int compare_certificates(const Certificate& a, const Certificate& b){
+    const std::size_t block = 16;
+    std::size_t common = std::min(a.size(), b.size());
+    std::size_t pos = 0;
+    while(pos + block <= common and std::memcmp(a.data() + pos, b.data() + pos, block * sizeof(std::uint32_t)) == 0){
+        pos += block;                                               //skip over equal blocks, memcmp is vectorized
+    }
+    for(; pos < common; pos++){                                    //then find the first differing word in the block
+        if(a[pos] != b[pos]){
+            return a[pos] < b[pos] ? -1 : 1;
+        }
+    }
+    if(a.size() == b.size()){
+        return 0;
+    }
+    return a.size() < b.size() ? -1 : 1;                                        //a proper prefix is the smaller one
+}
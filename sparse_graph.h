@@ -3,7 +3,7 @@
 
 /*
  * sparse_graph.h
- * Purpose: functions to read in graphs into an adjacency list format
+ * Purpose: functions to read in graphs into a compressed adjacency list format
  * and implement basic functions on such data
  */
 
@@ -15,8 +15,15 @@
 #include <sstream>
 #include <algorithm>
 #include <stdexcept>
-#include <set>
+#include <utility>
+#include <numeric>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <map>
+#include <unordered_map>
 
 static std::vector<std::vector<unsigned int>> empty_partition{};
 
@@ -29,64 +36,176 @@ using Permutation = std::vector<unsigned int>;
 
 
 /*
- * Vertex
- * Purpose: A subclass of Sparse representing a vertex and its edges
- * edges: a set in which vertices are stored representing an edge from that vertex to the ones in the set
- * add_edge(vertex): adds the vertex to the set edges
- * nof_edges(): degree of vertex
+ * Certificate
+ * Purpose: A compact canonical form of a (permuted) graph, packed into 32 bit words.
+ * The first word is the number of vertices n, followed by the pairs (i, j) with i >= j of all edges, sorted
+ * descendingly. For graphs with the same number of vertices, comparing two certificates lexicographically gives the
+ * same total order as comparing the n^2 bit strings of their adjacency matrices, rows and columns reversed, which
+ * were used as hash before: the first differing bit belongs to the greatest pair in which the graphs differ.
+ */
+using Certificate = std::vector<std::uint32_t>;
+
+/*
+ * compare_certificates(a, b)
+ *
+ * Returns: A negative number if a is smaller than b, 0 if they are equal and a positive number if a is greater.
+ *          The comparison is word-wise and skips over equal blocks of words with memcmp, which is vectorized.
+ */
+int compare_certificates(const Certificate& a, const Certificate& b);
+
+/*
+ * mix_hash(x)
  *
+ * Returns: The finalizer of splitmix64 applied to x, which spreads every input bit over the whole word. Used to build
+ *          64 bit fingerprints and invariants out of smaller values.
+ */
+inline std::uint64_t mix_hash(std::uint64_t x){
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+/*
+ * Neighbors
+ * Purpose: A lightweight view of the neighborhood of a vertex, i.e. a contiguous and sorted range of the adjacency
+ * array of a Sparse graph. Can be used in range based for loops and is only valid as long as the graph is.
+ */
+struct Neighbors{
+    const Vtype* first;
+    const Vtype* last;
+    const Vtype* begin() const { return first; }
+    const Vtype* end() const { return last; }
+    unsigned int size() const { return last - first; }
+};
+
+
+class Sparse;
+
+/*
+ * SparseStorage
+ * Purpose: Owns the arrays of a Sparse graph that was built in memory, e.g. by SparseBuilder::freeze()
+ */
+struct SparseStorage{
+    std::vector<unsigned int> offsets;
+    std::vector<Vtype> adjacency;
+    std::vector<unsigned int> colors;
+};
+
+/*
+ * SparseBuilder
+ * Purpose: The mutable counterpart of Sparse. Edges are collected here while a graph is read in or constructed and
+ * then the builder is frozen into an immutable Sparse graph before any search starts.
+ * SparseBuilder(n): A builder for a graph with n vertices and no edges
+ * add_edge(v1,v2): Adds the undirected edge, a parallel edge is only stored once after freezing
+ * add_edges(more_edges): Adds all edges of the given list
+ * reserve(num_edges): Pre-sizes the edge storage if the number of edges is known in advance
+ * initial_partition: optional cells of the initial partition, turned into vertex colors when freezing
+ * freeze(): Sorts the collected edges into the compressed adjacency arrays of a Sparse graph
+ */
+class SparseBuilder{
+    unsigned int num_vertices;
+    std::vector<std::pair<Vtype, Vtype>> edges;
+public:
+    std::vector<std::vector<unsigned int>> initial_partition{};
+    explicit SparseBuilder(unsigned int num_vertices);
+    void add_edge(Vtype v1, Vtype v2);
+    void add_edges(const std::vector<std::pair<Vtype, Vtype>>& more_edges);
+    void reserve(unsigned int num_edges);
+    unsigned int nof_vertices() const;
+    Sparse freeze() const;
+};
+
+
+/*
  * Sparse
- * Purpose: A set of data representing a sparse graph
- * Vertex: as described above
- * vertices: a vector storing all Vertex objects of the graph
- * add_edge(v1,v2): self explanatory
+ * Purpose: An immutable sparse graph in compressed sparse row (CSR) format
+ * offsets: n+1 entries, the neighbors of vertex v are adjacency[offsets[v]], ..., adjacency[offsets[v+1]-1]
+ * adjacency: the concatenation of all neighborhoods, each of them sorted ascending
+ * colors: n entries or nullptr if the graph is uncolored, vertices of the same color form a cell of the initial
+ *         partition and no_color marks a vertex that belongs to no cell
+ * storage: owns the memory the three arrays point into. This is either a SparseStorage with vectors or a memory
+ *          mapped binary graph file, see graph_io.h. Since the arrays never change, copies share their storage.
+ *
  * Sparse(n): Constructs a graph with n vertices and no edges
- * Sparse(filename):
+ * Sparse(storage, n, offsets, adjacency, colors): A graph viewing the given arrays, which have to live in storage
+ * Sparse(filename): Reads in the graph via read_graph(filename), see graph_io.h
  * print(): Outputs the graph as the adjacency list it is
  * nof_vertices(): returns the number of vertices
+ * nof_edges(): returns the number of (undirected) edges
+ * neighbors(vertex): returns the sorted neighborhood of vertex
+ * degree(vertex): returns the number of neighbors of vertex
+ * is_colored(), color(vertex): access to the vertex colors
+ * initial_partition(): the cells of equally colored vertices ordered by color, empty if the graph is uncolored
+ * connected_components(): the vertex sets of the connected components, each sorted and ordered by their first vertex
+ * induced_subgraph(vertices): the subgraph induced by the given vertices, the i-th of them becomes vertex i. The
+ *                             colors are kept as cells ordered by color, so they are renumbered
+ * cuthill_mckee_order(): the vertices in reverse Cuthill-McKee order. Each component is walked breadth first from a
+ *                        vertex of minimum degree, visiting the neighbors by ascending degree, and the whole order is
+ *                        reversed. Renumbering the graph in this order keeps neighborhoods close in memory
  */
 class Sparse{
-    class Vertex {
-    public:
-        Vertex();
-        void add_edge(Vtype vertex);
-        unsigned int nof_edges() const;
-        std::set<Vtype> edges;
-    };
+    std::shared_ptr<const void> storage;
+    unsigned int num_vertices;
+    const unsigned int* offsets;
+    const Vtype* adjacency;
+    const unsigned int* colors;
+
+    /*
+     * permuted_row(i, perm, inverse, row)
+     *
+     * Fills row with the neighbors j <= i of vertex i in the graph permuted by perm, descendingly. These are the
+     * entries of row i in a certificate. inverse has to be the inverse of perm.
+     */
+    void permuted_row(unsigned int i, const Permutation& perm, const Permutation& inverse,
+                      std::vector<std::uint32_t>& row) const;
 
 public:
-    std::vector<Vertex> vertices;
-    void add_edge(Vtype v1, Vtype v2);
+    static const unsigned int no_color = std::numeric_limits<unsigned int>::max();
+
     explicit Sparse(unsigned int num_vertices);
+    Sparse(std::shared_ptr<const void> storage, unsigned int num_vertices,
+           const unsigned int* offsets, const Vtype* adjacency, const unsigned int* colors);
     void print() const;
     unsigned int nof_vertices() const;
-    std::vector<std::vector<unsigned int>> initial_partition{};
+    unsigned int nof_edges() const;
+    std::vector<std::vector<unsigned int>> initial_partition() const;
+    std::vector<std::vector<unsigned int>> connected_components() const;
+    Sparse induced_subgraph(const std::vector<unsigned int>& vertices) const;
+    std::vector<unsigned int> cuthill_mckee_order() const;
+
+    Neighbors neighbors(const Vtype& vertex) const{
+        return Neighbors{adjacency + offsets[vertex], adjacency + offsets[vertex + 1]};
+    }
+    unsigned int degree(const Vtype& vertex) const{
+        return offsets[vertex + 1] - offsets[vertex];
+    }
+    bool is_colored() const{
+        return colors != nullptr;
+    }
+    unsigned int color(const Vtype& vertex) const{
+        return colors[vertex];
+    }
+    const unsigned int* offsets_data() const{
+        return offsets;
+    }
+    const Vtype* adjacency_data() const{
+        return adjacency;
+    }
 
     /*
      * Sparse(filename) creates an adjacency list structure to a given input graph
      *
-     * Parameters: filename Name or path to a .txt file of either of the following formats
-     *      Format 1:               //adjacency list
-     *      num_nodes               //number of nodes of the graph
-     *      node1_1 node1_2         //meaning there is and edge between node1_1 and node1_2
-     *      node2_1 node2_2
-     *      ...
-     *
-     *      Format 2:               //adjacency matrix
-     *      num_nodes               //number of nodes of the graph
-     *      10010...011             //the first row of the matrix, filled with 0 or 1
+     * Parameters: filename Name or path to a .txt file in adjacency list, adjacency matrix or dimacs format. The
+     *              formats are described at read_graph in graph_io.h.
      *
      * Only undirected and simple graphs are accepted, i.e. no loops or parallel edges are allowed.
      */
     explicit Sparse(const char* filename);
 
-    /*
-     * dimacs(filename)
-     *
-     *  For reference to the dimacs file format for graphs, see http://www.tcs.hut.fi/Software/bliss/fileformat.shtml
-     */
-    void dimacs(const char* filename);
-
     /*
      * degree(vertex, cell)
      *
@@ -101,18 +220,36 @@ public:
     /*
      * hash_value()
      *
-     * Returns: The hash value of the graph it is called on. This is simply given as n^2 bit string concatenating
-     *          the rows of an adjacency matrix.
+     * Returns: The certificate of the graph it is called on, see Certificate. It orders graphs exactly as an n^2 bit
+     *          string concatenating the rows of an adjacency matrix would but only needs O(n+m) space.
      */
-    std::vector<bool> hash_value() const;
+    Certificate hash_value() const;
 
     /*
-     * hash_value()
+     * perm_hash_value(perm)
+     *
+     * Same as hash_value but returns the certificate of the graph one would get after permuting the graph according to
+     * perm. This is better since an explicit construction of the permuted graph is not needed.
+     */
+    Certificate perm_hash_value(const Permutation& perm) const;
+
+    /*
+     * compare_perm_hash_value(perm, others)
+     *
+     * Lazily compares perm_hash_value(perm) to each of the given certificates without building it. The permuted graph
+     * is walked row by row in certificate order and the walk stops as soon as it differs from all of the others.
+     *
+     * Returns: For each certificate in others, the result compare_certificates(perm_hash_value(perm), other) would give
+     */
+    std::vector<int> compare_perm_hash_value(const Permutation& perm, const std::vector<const Certificate*>& others) const;
+
+    /*
+     * perm_fingerprint(perm)
      *
-     * Same as hash_value but returns the hash of the graph one would get after permuting the graph according to perm.
-     * This is better since an explicit construction of the permuted graph is not needed.
+     * Returns: A 64 bit fingerprint of perm_hash_value(perm). Every edge of the permuted graph is mixed into a hash on
+     *          its own and these are summed up, so no sorting is needed and equal certificates have equal fingerprints.
      */
-    std::vector<bool> perm_hash_value(const Permutation& perm) const;
+    std::uint64_t perm_fingerprint(const Permutation& perm) const;
 
 };
 
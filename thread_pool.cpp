@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+
+thread_local bool ThreadPool::on_worker = false;
+
+
+ThreadPool::ThreadPool(unsigned int num_threads){
+    if(num_threads == 0){
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for(unsigned int t=1; t<num_threads; t++){
+        helpers.emplace_back(&ThreadPool::help, this);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_posted.notify_all();
+    for(std::thread& helper: helpers){
+        helper.join();
+    }
+}
+
+unsigned int ThreadPool::nof_threads() const{
+    return helpers.size() + 1;
+}
+
+bool ThreadPool::on_worker_thread(){
+    return on_worker;
+}
+
+
+void ThreadPool::help(){
+    on_worker = true;
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        job_posted.wait(lock, [&]{ return stopping or generation != seen; });
+        if(stopping){
+            return;
+        }
+        seen = generation;
+        work_on_parts(lock);
+    }
+}
+
+void ThreadPool::work_on_parts(std::unique_lock<std::mutex>& lock){
+    while(next_part < job_parts){
+        unsigned int part = next_part++;
+        lock.unlock();
+        std::exception_ptr part_error;
+        try{
+            (*job)(job_count * part / job_parts, job_count * (part+1) / job_parts);
+        }
+        catch(...){
+            part_error = std::current_exception();
+        }
+        lock.lock();
+        if(part_error and not error){
+            error = part_error;
+        }
+        if(--parts_left == 0){
+            job_done.notify_all();
+        }
+    }
+}
+
+
+void ThreadPool::run(std::size_t count, std::size_t min_part_size,
+                     const std::function<void(std::size_t, std::size_t)>& compute){
+    std::size_t max_parts = std::max<std::size_t>(1, count / std::max<std::size_t>(1, min_part_size));
+    unsigned int num_parts = static_cast<unsigned int>(std::min<std::size_t>(nof_threads(), max_parts));
+    if(num_parts == 1 or on_worker){
+        compute(0, count);
+        return;
+    }
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+    std::unique_lock<std::mutex> lock(mutex);
+    job = &compute;
+    job_count = count;
+    job_parts = num_parts;
+    next_part = 0;
+    parts_left = num_parts;
+    error = nullptr;
+    generation++;
+    job_posted.notify_all();
+    work_on_parts(lock);                                              //the calling thread takes parts as well
+    job_done.wait(lock, [&]{ return parts_left == 0; });
+    job = nullptr;
+    if(error){
+        std::exception_ptr part_error = error;
+        error = nullptr;
+        std::rethrow_exception(part_error);
+    }
+}
+
+
+ThreadPool::WorkerScope::WorkerScope() : was_worker(on_worker){
+    on_worker = true;
+}
+
+ThreadPool::WorkerScope::~WorkerScope(){
+    on_worker = was_worker;
+}
@@ -0,0 +1,93 @@
+#ifndef NAUTY_THREAD_POOL_H
+#define NAUTY_THREAD_POOL_H
+
+/*
+ * thread_pool.h
+ * Purpose: A fixed set of threads for the data parallel parts of the refinement, such as computing a vertex invariant
+ * for many vertices at once. A search starts its threads once and hands them one range of work after the other, so a
+ * node of the search tree costs a wake up instead of creating and joining threads.
+ */
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * ThreadPool
+ * Purpose: Runs a function on consecutive parts of a range of items, on the calling thread and num_threads-1 helper
+ * threads kept for the lifetime of the pool
+ *
+ * Member variables:
+ * helpers: the helper threads, they sleep on job_posted until a new job is posted or the pool is destroyed
+ * mutex: guards all of the following
+ * job, job_count, job_parts: the function, the size of the range and the number of parts of the current job
+ * next_part: the part to be taken next, parts are taken by the helpers and the calling thread alike
+ * parts_left: the parts not finished yet, the calling thread waits on job_done until it is 0
+ * generation: increased with every job, so a helper knows whether it has seen the current one
+ * error: the first exception thrown by a part, rethrown by run
+ * stopping: set by the destructor to end the helpers
+ * run_mutex: lets one job run at a time if several threads share the pool
+ * on_worker: whether the current thread is a helper of some pool or in a WorkerScope
+ *
+ * ThreadPool(num_threads): Starts num_threads-1 helpers, with 0 as many as the hardware has threads
+ * nof_threads(): The number of threads working on a job, including the calling one
+ * run(count, min_part_size, compute): Splits the range [0, count) into at most nof_threads() consecutive parts with at
+ *                                     least min_part_size items each and calls compute(begin, end) for every part.
+ *                                     Returns once all parts are finished. On a worker thread, or with a single part,
+ *                                     compute(0, count) is called directly, so nested parallelism never
+ *                                     oversubscribes the hardware
+ * on_worker_thread(): Whether the current thread is a worker, see on_worker
+ *
+ * WorkerScope: Marks the current thread as a worker while it exists, for threads that already run in parallel to
+ *              others, like the workers of a parallel search or the searches of the components
+ */
+class ThreadPool{
+    std::vector<std::thread> helpers;
+    std::mutex mutex;
+    std::condition_variable job_posted;
+    std::condition_variable job_done;
+    const std::function<void(std::size_t, std::size_t)>* job = nullptr;
+    std::size_t job_count = 0;
+    unsigned int job_parts = 0;
+    unsigned int next_part = 0;
+    unsigned int parts_left = 0;
+    std::uint64_t generation = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+    std::mutex run_mutex;
+    static thread_local bool on_worker;
+
+    /*
+     * help() The loop of a helper thread
+     * work_on_parts(lock) Takes parts of the current job and runs them until none is left, lock holds mutex except
+     *                     while a part runs
+     */
+    void help();
+    void work_on_parts(std::unique_lock<std::mutex>& lock);
+
+public:
+    explicit ThreadPool(unsigned int num_threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    unsigned int nof_threads() const;
+    void run(std::size_t count, std::size_t min_part_size, const std::function<void(std::size_t, std::size_t)>& compute);
+    static bool on_worker_thread();
+
+    class WorkerScope{
+        bool was_worker;
+    public:
+        WorkerScope();
+        ~WorkerScope();
+        WorkerScope(const WorkerScope&) = delete;
+        WorkerScope& operator=(const WorkerScope&) = delete;
+    };
+};
+
+#endif //NAUTY_THREAD_POOL_H